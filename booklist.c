@@ -18,26 +18,119 @@
 */
 
 #include "booklist.h"
+#include "rssscan.h"
 #include <curl/curl.h>
-#include <sqlite3.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <regex.h>
+#include <time.h>
 #include <libxml/parser.h>
+#include <libxml/uri.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
 
-char curlErrorBuffer[CURL_ERROR_SIZE];
+#define MAX_WINDOW 16
+#define MAX_PAGES 1000
 
-int readEntries(xmlDocPtr xmlRss);
+// Strings of the running update, e.g. the pages already seen
+typedef struct
+{
+  char** strings;
+  int count;
+  int size;
+} stringlist;
 
 /*
- * This function is the callbackfunction for rss-receive
+ * Everything about the updates of one feed. Settings must not be changed while an
+ * update runs, contexts are independent of each other.
 */
-size_t receive(char* data, size_t size, size_t nmemb, xmlParserCtxtPtr* parser)
+struct listcontext
+{
+  // Paging, see setPaging
+  char pageParam[64];
+  int pageWindow;
+
+  // Time budget of an update, see setTimeBudget and cancelUpdate
+  long timeBudget;
+  double deadline;
+  atomic_int cancelled;
+
+  // Scan feeds without libxml2, see setFastScan
+  int fastScan;
+
+  // Receives the books of the running update
+  booksink* sink;
+
+  // Feed bytes of the running update as sent by the server and after decoding
+  size_t wireBytes;
+  size_t feedBytes;
+
+  // Link of the first item of every page read, see repeatedPage
+  stringlist firstLinks;
+
+  // Pages fetched by following links, see resolveNext
+  stringlist pageUrls;
+};
+
+typedef struct
 {
+  listcontext* list;
+  CURL* curl;
+  xmlParserCtxtPtr parser;
+  char* body;                   // Raw feed for the scanner, see setFastScan
+  size_t length;
+  size_t size;
+  int number;                   // Page number, 0 if the page was reached by a link
+  char url[1024];
+  char error[CURL_ERROR_SIZE];
+} page;
+
+#define LOW_SPEED_TIME 30
+
+#define DATE_PATTERN "([0-9][0-9]?)\\s(Jan|Feb|Mär|Apr|Mai|Jun|Jul|Aug|Sep|Okt|Nov|Dez)\\s([0-9]{4})"
+
+int readEntries(listcontext* ctx, xmlDocPtr xmlRss, char** next);
+
+/*
+ * This function is the callbackfunction for rss-receive, userdata is the page
+*/
+size_t receive(char* data, size_t size, size_t nmemb, void* userdata)
+{
+  page* p = userdata;
+  xmlParserCtxtPtr* parser = &p->parser;
+
+  // Compressed feeds arrive here already decoded
+  p->list->feedBytes += size*nmemb;
+
+  // Keep the raw feed for the scanner, it stays terminated
+  if (p->list->fastScan)
+  {
+    if (p->length + size*nmemb + 1 > p->size)
+    {
+      size_t grown = p->size ? p->size : 65536;
+      while (p->length + size*nmemb + 1 > grown)
+        grown *= 2;
+
+      char* body = realloc(p->body, grown);
+      if (body == NULL)
+      {
+        fprintf(stderr, "Failed to allocate memory for the feed\n");
+        return 0;
+      }
+      p->body = body;
+      p->size = grown;
+    }
+
+    memcpy(p->body + p->length, data, size*nmemb);
+    p->length += size*nmemb;
+    p->body[p->length] = 0;
+
+    return size * nmemb;
+  }
+
   // Does the parser already exist?
   if (*parser == NULL)
   {
@@ -63,61 +156,723 @@ size_t receive(char* data, size_t size, size_t nmemb, xmlParserCtxtPtr* parser)
 }
 
 /*
- * This function will retrieve the RSS-Feed from the URL and update
- * list of books in the database
+ * This function returns a monotonic timestamp in milliseconds
 */
-int updateList(char* url)
+double clockMs()
 {
-  CURL* curl;
-  CURLcode curlResult;
-  xmlParserCtxtPtr xmlParser = NULL;
-  xmlDocPtr xmlRss;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * This function sets the time an update may take at most, in seconds. Transfers and
+ * parsing are aborted once it is used up and the update is rolled back.
+*/
+void setTimeBudget(listcontext* ctx, int seconds)
+{
+  ctx->timeBudget = seconds * 1000L;
+}
+
+/*
+ * This function cancels the update that is currently running, it is rolled back as if
+ * it ran out of time. It may be called from signal handlers and other threads.
+*/
+void cancelUpdate(listcontext* ctx)
+{
+  atomic_store(&ctx->cancelled, 1);
+}
+
+/*
+ * This function checks if the update has to stop and reports why, stage names the work
+ * that was interrupted
+*/
+int expired(listcontext* ctx, char* stage)
+{
+  if (atomic_load(&ctx->cancelled))
+  {
+    fprintf(stderr, "Update cancelled while %s\n", stage);
+
+    return 1;
+  }
+
+  if (clockMs() > ctx->deadline)
+  {
+    fprintf(stderr, "Update ran out of time (%li s) while %s\n", ctx->timeBudget / 1000, stage);
+
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * This function is called by curl while transferring, it aborts the transfer once the
+ * update was cancelled or ran out of time, clientp is the context
+*/
+int progress(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+  listcontext* ctx = clientp;
+
+  return atomic_load(&ctx->cancelled) || (clockMs() > ctx->deadline);
+}
+
+/*
+ * This function configures paged feeds. If param is given, the pages are requested by
+ * setting this query parameter to 1, 2, ... and up to window pages are fetched at once,
+ * until a page without items (or a 404, or one repeating an earlier page) shows up. Without param, "next" links of the
+ * channel are followed instead, which can only be fetched one after another.
+*/
+void setPaging(listcontext* ctx, char* param, int window)
+{
+  memset(ctx->pageParam, 0, 64);
+  if (param != NULL)
+    strncpy(ctx->pageParam, param, 63);
+
+  ctx->pageWindow = window;
+  if (ctx->pageWindow < 1)
+    ctx->pageWindow = 1;
+  if (ctx->pageWindow > MAX_WINDOW)
+    ctx->pageWindow = MAX_WINDOW;
+}
+
+/*
+ * This function initializes curl and libxml2, it has to be called after loading the module
+ * and before any other thread uses it
+*/
+void initList()
+{
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+  xmlInitParser();
+}
+
+/*
+ * This function frees everything curl and libxml2 keep globally, it has to be called
+ * before unloading the module, once no other thread uses it any more
+*/
+void cleanupList()
+{
+  xmlCleanupParser();
+  curl_global_cleanup();
+}
+
+/*
+ * This function creates a context for the updates of a feed, without paging and with a
+ * time budget of 60 seconds. It returns NULL on errors.
+*/
+listcontext* newListContext()
+{
+  listcontext* ctx = calloc(1, sizeof(listcontext));
+  if (ctx == NULL)
+  {
+    fprintf(stderr, "Failed to allocate memory for the list context\n");
+
+    return NULL;
+  }
+
+  ctx->pageWindow = 1;
+  ctx->timeBudget = 60000;
+  atomic_init(&ctx->cancelled, 0);
+
+  return ctx;
+}
+
+/*
+ * This function frees a context, no update may be running on it
+*/
+void freeListContext(listcontext* ctx)
+{
+  free(ctx);
+}
+
+/*
+ * This function enables the scanner of rssscan.c, which reads the items directly from the
+ * received feed. Feeds it doesn't expect are still parsed by libxml2.
+*/
+void setFastScan(listcontext* ctx, int enabled)
+{
+  ctx->fastScan = enabled;
+}
+
+/*
+ * This function starts the transfer of a page, number 0 fetches url as it is
+*/
+page* startPage(listcontext* ctx, CURLM* multi, char* url, int number)
+{
+  page* p = calloc(1, sizeof(page));
+  if (p == NULL)
+  {
+    fprintf(stderr, "Failed to allocate memory for page\n");
+
+    return NULL;
+  }
+
+  if (number > 0)
+    snprintf(p->url, 1024, "%s%c%s=%i", url, strchr(url, '?') ? '&' : '?', ctx->pageParam, number);
+  else
+    strncpy(p->url, url, 1023);
+  p->number = number;
+  p->list = ctx;
+
+  p->curl = curl_easy_init();
+  if (!p->curl)
+  {
+    free(p);
+
+    return NULL;
+  }
+
+  curl_easy_setopt(p->curl, CURLOPT_ERRORBUFFER, p->error);
+  curl_easy_setopt(p->curl, CURLOPT_URL, p->url);
+  curl_easy_setopt(p->curl, CURLOPT_HEADER, 0L);
+  curl_easy_setopt(p->curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(p->curl, CURLOPT_WRITEFUNCTION, receive);
+  curl_easy_setopt(p->curl, CURLOPT_WRITEDATA, p);
+  curl_easy_setopt(p->curl, CURLOPT_PRIVATE, p);
+
+  // Offer every encoding curl supports, the feed compresses well
+  curl_easy_setopt(p->curl, CURLOPT_ACCEPT_ENCODING, "");
 
-  // Initialize curl and prepare operation
-  curl = curl_easy_init();
+  // Stay within the time budget, stalled transfers are given up early
+  long remaining = (long)(ctx->deadline - clockMs());
+  if (remaining < 1)
+    remaining = 1;
+  curl_easy_setopt(p->curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(p->curl, CURLOPT_CONNECTTIMEOUT_MS, remaining);
+  curl_easy_setopt(p->curl, CURLOPT_TIMEOUT_MS, remaining);
+  curl_easy_setopt(p->curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(p->curl, CURLOPT_LOW_SPEED_TIME, (long)LOW_SPEED_TIME);
+  curl_easy_setopt(p->curl, CURLOPT_NOPROGRESS, 0L);
+  curl_easy_setopt(p->curl, CURLOPT_XFERINFOFUNCTION, progress);
+  curl_easy_setopt(p->curl, CURLOPT_XFERINFODATA, ctx);
+
+  if (curl_multi_add_handle(multi, p->curl) != CURLM_OK)
+  {
+    fprintf(stderr, "Failed to start transfer of %s\n", p->url);
+    curl_easy_cleanup(p->curl);
+    free(p);
+
+    return NULL;
+  }
+
+  return p;
+}
+
+/*
+ * This function stops the transfer of a page and frees it, the bytes received so far
+ * are counted
+*/
+void freePage(CURLM* multi, page* p)
+{
+  curl_off_t received = 0;
+  if (curl_easy_getinfo(p->curl, CURLINFO_SIZE_DOWNLOAD_T, &received) == CURLE_OK)
+    p->list->wireBytes += received;
+
+  curl_multi_remove_handle(multi, p->curl);
+  curl_easy_cleanup(p->curl);
+
+  if (p->parser)
+  {
+    if (p->parser->myDoc)
+      xmlFreeDoc(p->parser->myDoc);
+    xmlFreeParserCtxt(p->parser);
+  }
+
+  free(p->body);
+  free(p);
+}
+
+/*
+ * This function adds str to the list unless it is in there already. It returns 1 if it
+ * was, 0 if it was added and -1 on errors.
+*/
+int addUnique(stringlist* list, const char* str)
+{
+  int i;
+
+  for (i = 0; i < list->count; i++)
+    if (!strcmp(list->strings[i], str))
+      return 1;
+
+  if (list->count == list->size)
+  {
+    int size = list->size ? list->size * 2 : 16;
+    char** grown = realloc(list->strings, size * sizeof(char*));
+    if (grown == NULL)
+    {
+      fprintf(stderr, "Failed to allocate memory for the pages\n");
+
+      return -1;
+    }
+    list->strings = grown;
+    list->size = size;
+  }
+
+  list->strings[list->count] = strdup(str);
+  if (list->strings[list->count] == NULL)
+  {
+    fprintf(stderr, "Failed to allocate memory for the pages\n");
 
-  if (!curl)
     return -1;
+  }
+  list->count++;
+
+  return 0;
+}
 
-  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curlErrorBuffer);
-  curl_easy_setopt(curl, CURLOPT_URL, url);
-  curl_easy_setopt(curl, CURLOPT_HEADER, 0);
-  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, receive);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &xmlParser);
+/*
+ * This function empties the list
+*/
+void clearStrings(stringlist* list)
+{
+  int i;
 
-  curlResult = curl_easy_perform(curl);
-  //curl_easy_cleanup(curl);
+  for (i = 0; i < list->count; i++)
+    free(list->strings[i]);
+  free(list->strings);
+  list->strings = NULL;
+  list->count = 0;
+  list->size = 0;
+}
 
-  if (curlResult != CURLE_OK)
+/*
+ * This function checks whether a page repeats one read before by the link of its first
+ * item. Servers that ignore the page parameter, or keep sending the last page for the
+ * numbers beyond, would otherwise be read up to MAX_PAGES times. It returns 1 for a
+ * repeated page, 0 for a new one and -1 on errors.
+*/
+int repeatedPage(listcontext* ctx, const char* firstLink)
+{
+  return addUnique(&ctx->firstLinks, firstLink);
+}
+
+/*
+ * This function extracts the due date from the description of a book and queues the book
+ * for the database, data is modified. It returns 0 on success or -1 on errors.
+*/
+int queueBook(listcontext* ctx, regex_t* dateExtract, char* title, char* url, char* data)
+{
+  // Match description against regexp
+  regmatch_t matches[4];
+  if (regexec(dateExtract, data, 4, matches, 0))
+  {
+    fprintf(stderr, "Invalid entry, date missing in description\n");
+
+    return -1;
+  }
+
+  // Extract date-data
+  data[matches[1].rm_eo] = 0;
+  data[matches[2].rm_eo] = 0;
+  data[matches[3].rm_eo] = 0;
+
+  // Month conversion
+  char* month;
+  if (!strcmp(&data[matches[2].rm_so], "Jan"))
+    month = "01";
+  else if (!strcmp(&data[matches[2].rm_so], "Feb"))
+    month = "02";
+  else if (!strcmp(&data[matches[2].rm_so], "Mär"))
+    month = "03";
+  else if (!strcmp(&data[matches[2].rm_so], "Apr"))
+    month = "04";
+  else if (!strcmp(&data[matches[2].rm_so], "Mai"))
+    month = "05";
+  else if (!strcmp(&data[matches[2].rm_so], "Jun"))
+    month = "06";
+  else if (!strcmp(&data[matches[2].rm_so], "Jul"))
+    month = "07";
+  else if (!strcmp(&data[matches[2].rm_so], "Aug"))
+    month = "08";
+  else if (!strcmp(&data[matches[2].rm_so], "Sep"))
+    month = "09";
+  else if (!strcmp(&data[matches[2].rm_so], "Okt"))
+    month = "10";
+  else if (!strcmp(&data[matches[2].rm_so], "Nov"))
+    month = "11";
+  else if (!strcmp(&data[matches[2].rm_so], "Dez"))
+    month = "12";
+  else
+  {
+    fprintf(stderr, "Invalid entry, unknown month: %s\n", &data[matches[2].rm_so]);
+
+    return -1;
+  }
+
+  // If day is in range 0-9, add a leading zero
+  if (strlen(&data[matches[1].rm_so]) == 1)
+  {
+    matches[1].rm_so--;
+    data[matches[1].rm_so] = '0';
+  }
+
+  // Build date string
+  char date[255];
+  date[0] = 0;
+  snprintf(date, 255, "%s-%s-%s", &data[matches[3].rm_so], month, &data[matches[1].rm_so]);
+
+  // Queue book for the database, the writer keeps its own copy of the strings
+  return ctx->sink->book(ctx->sink->data, title, url, date);
+}
+
+/*
+ * This function queues the books found by the scanner, it returns their amount or -1 on
+ * errors. Repeated pages (see repeatedPage) are read as empty. The caller has to begin the
+ * snapshot and end it.
+*/
+int readItems(listcontext* ctx, rssitems* items)
+{
+  regex_t dateExtract;
+  int i;
+
+  if (items->count > 0)
+  {
+    char* first = decodeView(items->items[0].link);
+    int repeated = first ? repeatedPage(ctx, first) : -1;
+
+    if (first == NULL)
+      fprintf(stderr, "Failed to allocate memory for book\n");
+    free(first);
+    if (repeated)
+      return repeated < 0 ? -1 : 0;
+  }
+
+  if (regcomp(&dateExtract, DATE_PATTERN, REG_EXTENDED))
   {
-    fprintf(stderr, "Error reading RSS-feed: %s\n", curlErrorBuffer);
-    if (xmlParser)
-      xmlFreeParserCtxt(xmlParser);
+    fprintf(stderr, "Failed to compile date-extracting regular expression\n");
 
     return -1;
   }
 
+  for (i = 0; i < items->count; i++)
+  {
+    // Give up between the items if the update has to stop
+    if (expired(ctx, "parsing"))
+    {
+      regfree(&dateExtract);
+
+      return -1;
+    }
+
+    char* title = decodeView(items->items[i].title);
+    char* url = decodeView(items->items[i].link);
+    char* data = decodeView(items->items[i].description);
+    int ret = -1;
+
+    if ((title == NULL) || (url == NULL) || (data == NULL))
+      fprintf(stderr, "Failed to allocate memory for book\n");
+    else
+      ret = queueBook(ctx, &dateExtract, title, url, data);
+
+    free(title);
+    free(url);
+    free(data);
+    if (ret)
+    {
+      regfree(&dateExtract);
+
+      return -1;
+    }
+  }
+
+  regfree(&dateExtract);
+  return items->count;
+}
+
+/*
+ * This function begins a new snapshot of the book list with the first page
+*/
+int beginSnapshot(listcontext* ctx, int* begun)
+{
+  if (!*begun)
+  {
+    if (ctx->sink->begin(ctx->sink->data))
+      return -1;
+    *begun = 1;
+  }
+
+  return 0;
+}
+
+/*
+ * This function finishes parsing a transferred page and queues its books. The snapshot is
+ * begun with the first page that arrives. It returns the amount of books or -1 on errors.
+*/
+int finishPage(page* p, CURLcode result, int* begun, char** next)
+{
+  listcontext* ctx = p->list;
+  long code = 0;
+  xmlDocPtr xmlRss;
+
+  if ((result == CURLE_OPERATION_TIMEDOUT) || (result == CURLE_ABORTED_BY_CALLBACK))
+  {
+    double connectTime = 0;
+    curl_easy_getinfo(p->curl, CURLINFO_CONNECT_TIME, &connectTime);
+    if (!expired(ctx, connectTime > 0 ? "transferring" : "connecting"))
+      fprintf(stderr, "Error reading RSS-feed: %s\n", p->error);
+
+    return -1;
+  }
+
+  if (result != CURLE_OK)
+  {
+    fprintf(stderr, "Error reading RSS-feed: %s\n", p->error);
+
+    return -1;
+  }
+
+  // Pages past the last one may not exist
+  curl_easy_getinfo(p->curl, CURLINFO_RESPONSE_CODE, &code);
+  if ((p->number > 1) && (code == 404))
+    return 0;
+
+  // Scan the feed, anything unexpected is handed to libxml2
+  if (ctx->fastScan && (p->body != NULL))
+  {
+    rssitems items;
+    int res = -1;
+
+    initItems(&items);
+    if (scanFeed(p->body, p->length, &items) >= 0)
+    {
+      if (next != NULL)
+        *next = NULL;
+      if (!beginSnapshot(ctx, begun))
+        res = readItems(ctx, &items);
+      freeItems(&items);
+
+      return res;
+    }
+    freeItems(&items);
+
+    p->parser = xmlCreatePushParserCtxt(NULL, NULL, p->body, p->length, NULL);
+    if (p->parser == NULL)
+    {
+      fprintf(stderr, "Could not create xmlPushParserCtxt.\n");
+
+      return -1;
+    }
+  }
+
   // Finish parsing, check validity and clean up
-  xmlParseChunk(xmlParser, NULL, 0, 1);
-  if (!xmlParser->wellFormed)
+  if (p->parser == NULL)
+  {
+    fprintf(stderr, "Error reading RSS-feed: no data received from %s\n", p->url);
+
+    return -1;
+  }
+
+  xmlParseChunk(p->parser, NULL, 0, 1);
+  if (!p->parser->wellFormed)
   {
     fprintf(stderr, "Error reading RSS-feed: XML is not well-formed\n");
-    xmlFreeParserCtxt(xmlParser);
 
     return -1;
   }
 
-  xmlRss = xmlParser->myDoc;
-  xmlFreeParserCtxt(xmlParser);
+  xmlRss = p->parser->myDoc;
+  p->parser->myDoc = NULL;
 
-  return readEntries(xmlRss);
+  // Begin a new snapshot of the book list
+  if (beginSnapshot(ctx, begun))
+  {
+    xmlFreeDoc(xmlRss);
+
+    return -1;
+  }
+
+  return readEntries(ctx, xmlRss, next);
 }
 
 /*
- * This function takes the RSS-Feed and updates the book database
+ * This function resolves the link to the next page found on p against the URL of p (after
+ * redirects), like a browser does for relative links. A link to a page fetched already
+ * ends the pages, next is NULL then. It returns 0 on success and -1 on errors.
 */
-int readEntries(xmlDocPtr xmlRss)
+int resolveNext(listcontext* ctx, page* p, char** next)
+{
+  char* base = NULL;
+  if ((curl_easy_getinfo(p->curl, CURLINFO_EFFECTIVE_URL, &base) != CURLE_OK) || (base == NULL))
+    base = p->url;
+
+  char* resolved = (char*)xmlBuildURI((xmlChar*)*next, (xmlChar*)base);
+  xmlFree(*next);
+  *next = resolved;
+  if (resolved == NULL)
+  {
+    fprintf(stderr, "Error reading RSS-feed: invalid link to the next page on %s\n", base);
+
+    return -1;
+  }
+
+  int known = addUnique(&ctx->pageUrls, resolved);
+  if (known)
+  {
+    xmlFree(resolved);
+    *next = NULL;
+  }
+
+  return known < 0 ? -1 : 0;
+}
+
+/*
+ * This function will retrieve the RSS-Feed from the URL and update
+ * list of books in the database. The books are handed to the sink (the writer thread),
+ * which commits them (or rolls back on failure) and notifies the dockapp.
+ * Paged feeds (see setPaging) are parsed page by page as they arrive and all
+ * of them are committed at once. A page repeating one before, or a link back to
+ * a page fetched already, ends them like an empty page. The bytes transferred are handed to the sink
+ * with the end of the update, also if it failed.
+*/
+int updateList(listcontext* ctx, char* url, booksink* output)
+{
+  CURLM* multi;
+  page* inFlight[MAX_WINDOW];
+  int ninFlight = 0;
+  int nextNumber = 1;
+  int lastNumber = MAX_PAGES + 1;
+  int pages = 1;
+  int begun = 0;
+  int failed = 0;
+  int i;
+
+  // The budget starts now
+  ctx->sink = output;
+  atomic_store(&ctx->cancelled, 0);
+  ctx->deadline = clockMs() + ctx->timeBudget;
+  ctx->wireBytes = 0;
+  ctx->feedBytes = 0;
+
+  // Initialize curl and start the first page(s)
+  multi = curl_multi_init();
+  if (!multi)
+  {
+    feedstats none = { 0, 0 };
+    output->end(output->data, 0, &none);
+    return -1;
+  }
+
+  if (ctx->pageParam[0])
+  {
+    while ((ninFlight < ctx->pageWindow) && !failed)
+    {
+      inFlight[ninFlight] = startPage(ctx, multi, url, nextNumber++);
+      if (inFlight[ninFlight] == NULL)
+        failed = 1;
+      else
+        ninFlight++;
+    }
+  }
+  else
+  {
+    inFlight[0] = addUnique(&ctx->pageUrls, url) ? NULL : startPage(ctx, multi, url, 0);
+    if (inFlight[0] == NULL)
+      failed = 1;
+    else
+      ninFlight = 1;
+  }
+
+  // Run the transfers and handle every page as soon as it is complete
+  while ((ninFlight > 0) && !failed)
+  {
+    CURLMsg* msg;
+    int running;
+    int left;
+
+    if (curl_multi_perform(multi, &running) != CURLM_OK)
+    {
+      fprintf(stderr, "Error reading RSS-feed: transfer failed\n");
+      failed = 1;
+      break;
+    }
+
+    while (!failed && ((msg = curl_multi_info_read(multi, &left)) != NULL))
+    {
+      page* p;
+      char* next = NULL;
+      int items = 0;
+
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&p);
+
+      // Pages behind the first empty one are ignored
+      if (p->number <= lastNumber)
+        items = finishPage(p, msg->data.result, &begun, ctx->pageParam[0] ? NULL : &next);
+      if ((items == 0) && (p->number > 0) && (p->number < lastNumber))
+        lastNumber = p->number;
+      if ((items >= 0) && (next != NULL) && resolveNext(ctx, p, &next))
+        items = -1;
+
+      for (i = 0; i < ninFlight; i++)
+        if (inFlight[i] == p)
+          inFlight[i] = inFlight[--ninFlight];
+      freePage(multi, p);
+
+      if (items < 0)
+      {
+        xmlFree(next);
+        failed = 1;
+        break;
+      }
+
+      // Keep the window full, or follow the link to the next page
+      if (ctx->pageParam[0] && (nextNumber < lastNumber) && (nextNumber <= MAX_PAGES))
+        p = startPage(ctx, multi, url, nextNumber++);
+      else if (next != NULL)
+      {
+        p = NULL;
+        if (++pages <= MAX_PAGES)
+          p = startPage(ctx, multi, next, 0);
+        else
+          fprintf(stderr, "Error reading RSS-feed: more than %i pages\n", MAX_PAGES);
+        xmlFree(next);
+      }
+      else
+        continue;
+
+      if (p == NULL)
+        failed = 1;
+      else
+        inFlight[ninFlight++] = p;
+    }
+
+    if ((ninFlight > 0) && !failed)
+    {
+      if (expired(ctx, "transferring"))
+        failed = 1;
+      else
+        curl_multi_wait(multi, NULL, 0, 100, NULL);
+    }
+  }
+
+  // Clean up the transfers that are still running after a failure
+  for (i = 0; i < ninFlight; i++)
+    freePage(multi, inFlight[i]);
+  curl_multi_cleanup(multi);
+  clearStrings(&ctx->firstLinks);
+  clearStrings(&ctx->pageUrls);
+
+  // Commit the new list only if every page could be read
+  feedstats stats = { ctx->wireBytes, ctx->feedBytes };
+  if (failed || !begun)
+  {
+    output->end(output->data, 0, &stats);
+    return -1;
+  }
+
+  return output->end(output->data, 1, &stats);
+}
+
+/*
+ * This function takes the RSS-Feed and queues its books for the database. It returns
+ * the amount of books or -1 on errors. If next is given, it is set to the link of the
+ * next page (or NULL), which has to be freed with xmlFree. The caller has to begin the
+ * snapshot and end it.
+*/
+int readEntries(listcontext* ctx, xmlDocPtr xmlRss, char** next)
 {
   // Build XPath to select all booktitles
   xmlXPathContextPtr xpathCtxt = NULL;
@@ -147,7 +902,7 @@ int readEntries(xmlDocPtr xmlRss)
 
   // Build regexp to extract the date from the description
   regex_t dateExtract;
-  if (regcomp(&dateExtract, "([0-9][0-9]?)\\s(Jan|Feb|Mär|Apr|Mai|Jun|Jul|Aug|Sep|Okt|Nov|Dez)\\s([0-9]{4})", REG_EXTENDED))
+  if (regcomp(&dateExtract, DATE_PATTERN, REG_EXTENDED))
   {
     fprintf(stderr, "Failed to compile date-extracting regular expression\n");
     xmlXPathFreeObject(xpathObj);
@@ -157,55 +912,57 @@ int readEntries(xmlDocPtr xmlRss)
     return -1;
   }
 
-  // Begin transaction on database and clear book list
-  if (beginTransaction())
+  // Look for the link to the next page
+  if (next != NULL)
   {
-    xmlXPathFreeObject(xpathObj);
-    xmlXPathFreeContext(xpathCtxt);
-    xmlFreeDoc(xmlRss);
+    xmlXPathObjectPtr linkObj = xmlXPathEvalExpression("/rss/channel/*[local-name()='link'][@rel='next']/@href", xpathCtxt);
 
-    return -1;
+    *next = NULL;
+    if ((linkObj != NULL) && (linkObj->nodesetval != NULL) && (linkObj->nodesetval->nodeNr > 0))
+      *next = (char*)xmlNodeGetContent(linkObj->nodesetval->nodeTab[0]);
+    xmlXPathFreeObject(linkObj);
   }
-  clearBooklist();
 
-  // Extract data from every entry
-  for (i = 0; i < xpathObj->nodesetval->nodeNr; i++)
+  // A repeated page (see repeatedPage) is read as empty and ends the pages
+  res = xpathObj->nodesetval ? xpathObj->nodesetval->nodeNr : 0;
+  if (res > 0)
   {
-    char* title = NULL;
-    char* url = NULL;
-    char* data = NULL;
-    xmlNodePtr book = xpathObj->nodesetval->nodeTab[i];
-
-    // Check all child nodes for their content
     xmlNodePtr entry;
-    for (entry = book->children; entry != NULL; entry = entry->next)
+    int repeated = 0;
+
+    for (entry = xpathObj->nodesetval->nodeTab[0]->children; entry != NULL; entry = entry->next)
     {
-      if (xmlStrEqual(entry->name, "title"))
-        title = (char*)xmlNodeGetContent(entry);
       if (xmlStrEqual(entry->name, "link"))
-        url = (char*)xmlNodeGetContent(entry);
-      if (xmlStrEqual(entry->name, "description"))
-        data = (char*)xmlNodeGetContent(entry);
+      {
+        char* first = (char*)xmlNodeGetContent(entry);
+        repeated = first ? repeatedPage(ctx, first) : -1;
+        xmlFree(first);
+        break;
+      }
     }
 
-    // Fail if any string is missing
-    if ((title == NULL) || (url == NULL) || (data == NULL))
+    if (repeated)
     {
-      fprintf(stderr, "Invalid entry, datafield(s) missing\n");
+      if (next != NULL)
+      {
+        xmlFree(*next);
+        *next = NULL;
+      }
       xmlXPathFreeObject(xpathObj);
       xmlXPathFreeContext(xpathCtxt);
       xmlFreeDoc(xmlRss);
       regfree(&dateExtract);
 
-      return -1;
+      return repeated < 0 ? -1 : 0;
     }
+  }
 
-    // Match description against regexp
-    regmatch_t matches[4];
-    int ret;
-    if (ret = regexec(&dateExtract, data, 4, matches, 0))
+  // Extract data from every entry
+  for (i = 0; i < res; i++)
+  {
+    // Give up between the items if the update has to stop
+    if (expired(ctx, "parsing"))
     {
-      fprintf(stderr, "Invalid entry, date missing in description\n");
       xmlXPathFreeObject(xpathObj);
       xmlXPathFreeContext(xpathCtxt);
       xmlFreeDoc(xmlRss);
@@ -214,79 +971,170 @@ int readEntries(xmlDocPtr xmlRss)
       return -1;
     }
 
-    // Extract date-data
-    data[matches[1].rm_eo] = 0;
-    data[matches[2].rm_eo] = 0;
-    data[matches[3].rm_eo] = 0;
-
-    // Month conversion
-    char* month;
-    if (!strcmp(&data[matches[2].rm_so], "Jan"))
-      month = "01";
-    else if (!strcmp(&data[matches[2].rm_so], "Feb"))
-      month = "02";
-    else if (!strcmp(&data[matches[2].rm_so], "Mär"))
-      month = "03";
-    else if (!strcmp(&data[matches[2].rm_so], "Apr"))
-      month = "04";
-    else if (!strcmp(&data[matches[2].rm_so], "Mai"))
-      month = "05";
-    else if (!strcmp(&data[matches[2].rm_so], "Jun"))
-      month = "06";
-    else if (!strcmp(&data[matches[2].rm_so], "Jul"))
-      month = "07";
-    else if (!strcmp(&data[matches[2].rm_so], "Aug"))
-      month = "08";
-    else if (!strcmp(&data[matches[2].rm_so], "Sep"))
-      month = "09";
-    else if (!strcmp(&data[matches[2].rm_so], "Okt"))
-      month = "10";
-    else if (!strcmp(&data[matches[2].rm_so], "Nov"))
-      month = "11";
-    else if (!strcmp(&data[matches[2].rm_so], "Dez"))
-      month = "12";
-    else
+    char* title = NULL;
+    char* url = NULL;
+    char* data = NULL;
+    xmlNodePtr book = xpathObj->nodesetval->nodeTab[i];
+
+    // Check all child nodes for their content
+    xmlNodePtr entry;
+    for (entry = book->children; entry != NULL; entry = entry->next)
+    {
+      if (xmlStrEqual(entry->name, "title") && (title == NULL))
+        title = (char*)xmlNodeGetContent(entry);
+      if (xmlStrEqual(entry->name, "link") && (url == NULL))
+        url = (char*)xmlNodeGetContent(entry);
+      if (xmlStrEqual(entry->name, "description") && (data == NULL))
+        data = (char*)xmlNodeGetContent(entry);
+    }
+
+    // Fail if any string is missing
+    if ((title == NULL) || (url == NULL) || (data == NULL))
     {
-      fprintf(stderr, "Invalid entry, unknown month: %s\n", data[matches[2].rm_so]);
+      fprintf(stderr, "Invalid entry, datafield(s) missing\n");
+      xmlFree(title);
+      xmlFree(url);
+      xmlFree(data);
       xmlXPathFreeObject(xpathObj);
       xmlXPathFreeContext(xpathCtxt);
       xmlFreeDoc(xmlRss);
       regfree(&dateExtract);
-      abortTransaction();
 
       return -1;
     }
 
-    // If day is in range 0-9, add a leading zero
-    if (strlen(&data[matches[1].rm_so]) == 1)
-    {
-      matches[1].rm_so--;
-      data[matches[1].rm_so] = '0';
-    }
-
-    // Build date string
-    char date[255];
-    date[0] = 0;
-    snprintf(date, 255, "%s-%s-%s", &data[matches[3].rm_so], month, &data[matches[1].rm_so]);
-
-    // Insert book to database
-    if (addBook(title, url, date))
+    // Extract the due date and queue the book
+    int ret = queueBook(ctx, &dateExtract, title, url, data);
+    xmlFree(title);
+    xmlFree(url);
+    xmlFree(data);
+    if (ret)
     {
       xmlXPathFreeObject(xpathObj);
       xmlXPathFreeContext(xpathCtxt);
       xmlFreeDoc(xmlRss);
       regfree(&dateExtract);
-      abortTransaction();
 
       return -1;
     }
   }
 
-  endTransaction();
-
   xmlXPathFreeObject(xpathObj);
   xmlXPathFreeContext(xpathCtxt);
   xmlFreeDoc(xmlRss);
   regfree(&dateExtract);
   return res;
 }
+
+/*
+ * This function extracts the fields of all items with libxml2 like readEntries, without
+ * queueing them. It returns the amount of items or -1 on errors.
+*/
+int benchLibxml(char* feed, int length)
+{
+  xmlDocPtr xmlRss = xmlReadMemory(feed, length, NULL, NULL, 0);
+  if (xmlRss == NULL)
+    return -1;
+
+  xmlXPathContextPtr xpathCtxt = xmlXPathNewContext(xmlRss);
+  xmlXPathObjectPtr xpathObj = xmlXPathEvalExpression("/rss/channel/item", xpathCtxt);
+  int res = xpathObj->nodesetval ? xpathObj->nodesetval->nodeNr : 0;
+  int i;
+
+  for (i = 0; i < res; i++)
+  {
+    xmlNodePtr entry;
+    for (entry = xpathObj->nodesetval->nodeTab[i]->children; entry != NULL; entry = entry->next)
+      if (xmlStrEqual(entry->name, "title") || xmlStrEqual(entry->name, "link") || xmlStrEqual(entry->name, "description"))
+        xmlFree(xmlNodeGetContent(entry));
+  }
+
+  xmlXPathFreeObject(xpathObj);
+  xmlXPathFreeContext(xpathCtxt);
+  xmlFreeDoc(xmlRss);
+  return res;
+}
+
+/*
+ * This function extracts the fields of all items with the scanner like readItems, without
+ * queueing them. It returns the amount of items or -1 on errors.
+*/
+int benchScan(char* feed, int length)
+{
+  rssitems items;
+  int i;
+
+  initItems(&items);
+  if (scanFeed(feed, length, &items) < 0)
+  {
+    freeItems(&items);
+    return -1;
+  }
+
+  for (i = 0; i < items.count; i++)
+  {
+    free(decodeView(items.items[i].title));
+    free(decodeView(items.items[i].link));
+    free(decodeView(items.items[i].description));
+  }
+
+  freeItems(&items);
+  return i;
+}
+
+/*
+ * This function compares both parsers on a generated feed with the given amount of items
+ * and prints their throughput. It returns 0 on success or -1 on errors.
+*/
+int benchParsers(int count)
+{
+  int rounds = 20;
+  int length = 0;
+  int i;
+
+  if (count < 1)
+  {
+    fprintf(stderr, "The benchmark needs at least one item\n");
+
+    return -1;
+  }
+
+  char* feed = malloc(count * 200L + 256);
+  if (feed == NULL)
+  {
+    fprintf(stderr, "Failed to allocate memory for the feed\n");
+
+    return -1;
+  }
+
+  length += sprintf(feed, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<rss version=\"2.0\"><channel><title>Bench</title>\n");
+  for (i = 0; i < count; i++)
+    length += sprintf(feed + length, "<item><title>Book %i &amp; Co</title><link>http://localhost/book?id=%i</link>"
+                      "<description>Ausgeliehen bis %i Mär 2030</description><guid>%i</guid></item>\n", i, i, i % 28 + 1, i);
+  length += sprintf(feed + length, "</channel></rss>\n");
+
+  char* names[2] = { "libxml2", "scanner" };
+  int (*parsers[2])(char*, int) = { benchLibxml, benchScan };
+  int p;
+  for (p = 0; p < 2; p++)
+  {
+    double start = clockMs();
+    int round;
+
+    for (round = 0; round < rounds; round++)
+      if (parsers[p](feed, length) != count)
+      {
+        fprintf(stderr, "The %s failed to read the feed\n", names[p]);
+        free(feed);
+
+        return -1;
+      }
+
+    double elapsed = (clockMs() - start) / rounds;
+    printf("%s: %i items (%i KiB) in %.2f ms, %.0f items/s, %.1f MiB/s\n", names[p], count, length / 1024, elapsed,
+           count / elapsed * 1000, length / elapsed * 1000 / 1048576);
+  }
+
+  free(feed);
+  return 0;
+}
@@ -20,6 +20,44 @@
 #ifndef _BOOKLIST_H
 #define _BOOKLIST_H
 
-int updateList(char* url);
+#include <stddef.h>
+
+// Bytes of an update, compressed feeds are smaller on the wire than decoded
+typedef struct
+{
+  size_t wireBytes;   // Received from the server
+  size_t feedBytes;   // Handed to the parser
+} feedstats;
+
+// Receives the books of an update, data is handed to every call (see writer.h)
+typedef struct
+{
+  void* data;
+  int (*begin)(void* data);
+  int (*book)(void* data, char* title, char* url, char* date);
+  int (*end)(void* data, int commit, feedstats* stats);
+} booksink;
+
+typedef struct listcontext listcontext;
+
+// Entry points of the fetch module, see fetcher.c
+
+// Once per process, before and after all other calls
+void initList();
+void cleanupList();
+
+// Safe to call from any thread, every context may run an update in parallel to the others
+listcontext* newListContext();
+int benchParsers(int count);
+
+// Only one thread at a time per context
+void freeListContext(listcontext* ctx);
+void setPaging(listcontext* ctx, char* param, int window);
+void setTimeBudget(listcontext* ctx, int seconds);
+void setFastScan(listcontext* ctx, int enabled);
+int updateList(listcontext* ctx, char* url, booksink* output);
+
+// Safe to call from any thread and from signal handlers, also while updateList runs
+void cancelUpdate(listcontext* ctx);
 
 #endif // _BOOKLIST_H
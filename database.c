@@ -17,409 +17,259 @@
  * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <sqlite3.h>
+#include "database.h"
+#include "storage.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-
-sqlite3* database = NULL;
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
 
 /*
- * This function will create/open the database given in the parameter db.
- * It will create all the neccessary tables if they don't yet exist. This
- * function must be called and it's success verified before using any other
- * functions of this library.
+ * This function returns the backend with the given name ("sqlite" or "memory"). The
+ * memory backend keeps the books only as long as the process runs and is not shared
+ * with other processes.
 */
-int openDatabase(char* db)
+storage* findStorage(char* name)
 {
-  // Create/Open the database
-  if (sqlite3_open_v2(db, &database, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK)
-  {
-    fprintf(stderr, "Failed to open database %s, reason: %s\n", db, sqlite3_errmsg(database));
-    sqlite3_close(database);
+  if (!strcmp(name, sqliteStorage.name))
+    return &sqliteStorage;
+  if (!strcmp(name, memoryStorage.name))
+    return &memoryStorage;
 
-    return -1;
-  }
+  fprintf(stderr, "Unknown storage %s\n", name);
 
-  // Create the neccessary tables if they don't exist
-  sqlite3_stmt* command;
-  if (sqlite3_prepare_v2(database, "CREATE TABLE IF NOT EXISTS books (name string not null, url string, date string not null);", -1, &command, NULL))
-  {
-    fprintf(stderr, "Failed to create books-table, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_close(database);
+  return NULL;
+}
 
-    return -1;
-  }
+/*
+ * This function opens the database db with the given backend, readOnly selects
+ * openDatabaseReadOnly of the backend. It returns the context or NULL on errors.
+*/
+dbcontext* newContext(char* name, char* db, int readOnly)
+{
+  storage* backend = findStorage(name);
+  if (backend == NULL)
+    return NULL;
 
-  if (sqlite3_step(command) != SQLITE_DONE)
+  dbcontext* ctx = calloc(1, sizeof(dbcontext));
+  if (ctx == NULL)
   {
-    fprintf(stderr, "Failed to create books-table, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
-    sqlite3_close(database);
+    fprintf(stderr, "Failed to allocate memory for the database context\n");
 
-    return -1;
+    return NULL;
   }
-  sqlite3_finalize(command);
 
-  if (sqlite3_prepare_v2(database, "CREATE TABLE IF NOT EXISTS config (key string unique, value string);", -1, &command, NULL))
-  {
-    fprintf(stderr, "Failed to create config-table, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_close(database);
-
-    return -1;
-  }
+  ctx->backend = backend;
+  ctx->updateLock = -1;
+  strncpy(ctx->db, db, 1023);
 
-  if (sqlite3_step(command) != SQLITE_DONE)
+  ctx->connection = readOnly ? backend->openDatabaseReadOnly(db) : backend->openDatabase(db);
+  if (ctx->connection == NULL)
   {
-    fprintf(stderr, "Failed to create config-table, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
-    sqlite3_close(database);
+    free(ctx);
 
-    return -1;
+    return NULL;
   }
-  sqlite3_finalize(command);
-
-  // Database successfully initialized
 
-  return 0;
+  return ctx;
 }
 
 /*
- * This function starts a transaction on the database. Make sure that you finish
- * this transaction by calling endTransaction of abortTransaction. If the return
- * value is not 0, the transaction has to be assumed as not started.
+ * This function opens (and creates) the database db with the storage backend name. Every
+ * thread has to open its own context. It returns the context or NULL on errors.
 */
-int beginTransaction()
+dbcontext* openDatabase(char* name, char* db)
 {
-  // Create and execute begin transaction command
-  sqlite3_stmt* command;
-  if (sqlite3_prepare_v2(database, "BEGIN EXCLUSIVE;", -1, &command, NULL))
-  {
-    fprintf(stderr, "Failed to start transaction, reason: %s\n", sqlite3_errmsg(database));
-
-    return -1;
-  }
-
-  if (sqlite3_step(command) != SQLITE_DONE)
-  {
-    fprintf(stderr, "Failed to start transaction, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
-
-    return -1;
-  }
-  sqlite3_finalize(command);
-  
-  return 0;
+  return newContext(name, db, 0);
 }
 
 /*
- * This function will close the database, call at the end of the program before exiting.
+ * This function opens the existing database db for reading only, see openDatabase
 */
-int closeDatabase()
+dbcontext* openDatabaseReadOnly(char* name, char* db)
 {
-  sqlite3_close(database); 
-  return 0;
+  return newContext(name, db, 1);
 }
 
 /*
- * This function will clear the contents of the table books. It should be called when
- * updating the list of books from the datasource. You should start a transaction
- * before calling this function to ensure you can rollback to the previous state in case
- * something goes wrong during data retrieval.
+ * This function closes the database and frees the context, an update lock is released
 */
-int clearBooklist()
+void closeDatabase(dbcontext* ctx)
 {
-  // Create and execute delete command
-  sqlite3_stmt* command;
-  if (sqlite3_prepare_v2(database, "DELETE FROM books;", -1, &command, NULL))
-  {
-    fprintf(stderr, "Failed to clear booklist, reason: %s\n", sqlite3_errmsg(database));
-
-    return -1;
-  }
-
-  if (sqlite3_step(command) != SQLITE_DONE)
-  {
-    fprintf(stderr, "Failed to clear booklist, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
+  if (ctx->updateLock >= 0)
+    close(ctx->updateLock);
 
-    return -1;
-  }
-  sqlite3_finalize(command);
-  
-  return 0;
+  ctx->backend->closeDatabase(ctx->connection);
+  free(ctx);
 }
 
 /*
- * This function will add a book to the books-table.
+ * The following functions hand the call to the backend of the context, see sqlitestore.c
+ * for their documentation
 */
-int addBook(char* title, char* url, char* date)
+int setBusyTimeout(dbcontext* ctx, int ms)
 {
-  // Create, bind and execute the insert command
-  sqlite3_stmt* command;
-  if (sqlite3_prepare_v2(database, "INSERT INTO books (name, url, date) VALUES(?, ?, date(?));", -1, &command, NULL))
-  {
-    fprintf(stderr, "Failed to insert book, reason: %s\n", sqlite3_errmsg(database));
-
-    return -1;
-  }
-
-  if (sqlite3_bind_text(command, 1, title, -1, SQLITE_STATIC))
-  {
-    fprintf(stderr, "Failed to insert book, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
-
-    return -1;
-  }
-
-  if (sqlite3_bind_text(command, 2, url, -1, SQLITE_STATIC))
-  {
-    fprintf(stderr, "Failed to insert book, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
-
-    return -1;
-  }
-
-  if (sqlite3_bind_text(command, 3, date, -1, SQLITE_STATIC))
-  {
-    fprintf(stderr, "Failed to insert book, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
-
-    return -1;
-  }
-
-  if (sqlite3_step(command) != SQLITE_DONE)
-  {
-    fprintf(stderr, "Failed to insert book, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
-
-    return -1;
-  }
-  sqlite3_finalize(command);
-  
-  return 0;
+  return ctx->backend->setBusyTimeout(ctx->connection, ms);
 }
 
-/*
- * This function ends a transaction on the database. The changes done in the transaction
- * will be commited.
-*/
-int endTransaction()
+int dataChanged(dbcontext* ctx)
 {
-  // Create and execute end transaction command
-  sqlite3_stmt* command;
-  if (sqlite3_prepare_v2(database, "COMMIT;", -1, &command, NULL))
-  {
-    fprintf(stderr, "Failed to commit transaction, reason: %s\n", sqlite3_errmsg(database));
-
-    return -1;
-  }
-
-  if (sqlite3_step(command) != SQLITE_DONE)
-  {
-    fprintf(stderr, "Failed to commit transaction, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
+  return ctx->backend->dataChanged(ctx->connection);
+}
 
-    return -1;
-  }
-  sqlite3_finalize(command);
-  
-  return 0;
+int beginTransaction(dbcontext* ctx)
+{
+  return ctx->backend->beginTransaction(ctx->connection);
 }
 
-/*
- * This function ends a transaction on the database. The changes done in the transaction
- * will be rolled back.
-*/
-int abortTransaction()
+int clearBooklist(dbcontext* ctx)
 {
-  // Create and execute rollback transaction command
-  sqlite3_stmt* command;
-  if (sqlite3_prepare_v2(database, "ROLLBACK;", -1, &command, NULL))
-  {
-    fprintf(stderr, "Failed to roll back transaction, reason: %s\n", sqlite3_errmsg(database));
+  return ctx->backend->clearBooklist(ctx->connection);
+}
 
-    return -1;
-  }
+int addBook(dbcontext* ctx, char* title, char* url, char* date)
+{
+  return ctx->backend->addBook(ctx->connection, title, url, date);
+}
 
-  if (sqlite3_step(command) != SQLITE_DONE)
-  {
-    fprintf(stderr, "Failed to roll back transaction, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
+int endTransaction(dbcontext* ctx)
+{
+  return ctx->backend->endTransaction(ctx->connection);
+}
 
-    return -1;
-  }
-  sqlite3_finalize(command);
-  
-  return 0;
+int abortTransaction(dbcontext* ctx)
+{
+  return ctx->backend->abortTransaction(ctx->connection);
 }
 
-/*
- * This function returns the amound of books where the time left is "Ok" (>5 days)
-*/
-int getOk()
+int getOk(dbcontext* ctx)
 {
-  // Create and execute the select-command
-  sqlite3_stmt* command;
-  if (sqlite3_prepare_v2(database, "SELECT COUNT(*) FROM books WHERE date > date('now', '+5 day');", -1, &command, NULL))
-  {
-    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+  return ctx->backend->getOk(ctx->connection);
+}
 
-    return -1;
-  }
+int getSoon(dbcontext* ctx)
+{
+  return ctx->backend->getSoon(ctx->connection);
+}
 
-  if (sqlite3_step(command) != SQLITE_ROW)
-  {
-    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
+int getCritical(dbcontext* ctx)
+{
+  return ctx->backend->getCritical(ctx->connection);
+}
 
-    return -1;
-  }
+int getLate(dbcontext* ctx)
+{
+  return ctx->backend->getLate(ctx->connection);
+}
 
-  // Obtain the data
-  int books = sqlite3_column_int(command, 0);
-  sqlite3_finalize(command);
-  
-  return books;
+int loadDueDays(dbcontext* ctx, duedays* dd)
+{
+  return ctx->backend->loadDueDays(ctx->connection, dd);
 }
 
 /*
- * This function returns the amound of books where the time left is "Soon" (not today but <=5days)
+ * This function counts the books per bucket like countBuckets, but lets the backend count
+ * them instead of loading every due date. Every boundary costs one count on the date
+ * index, which suits callers asking only once (like --query).
 */
-int getSoon()
+int countDueBooks(dbcontext* ctx, int32_t day, int* thresholds, int nthresholds, int* counts)
 {
-  // Create and execute the select-command
-  sqlite3_stmt* command;
-  if (sqlite3_prepare_v2(database, "SELECT COUNT(*) FROM books WHERE date <= date('now', '+5 day') AND date > date('now');", -1, &command, NULL))
-  {
-    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
-
+  int i;
+  int prev = ctx->backend->countBooks(ctx->connection, day);
+  if (prev < 0)
     return -1;
-  }
 
-  if (sqlite3_step(command) != SQLITE_ROW)
+  counts[0] = prev;
+  for (i = 0; i < nthresholds; i++)
   {
-    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
+    int next = ctx->backend->countBooks(ctx->connection, day + thresholds[i] + 1);
+    if (next < 0)
+      return -1;
 
-    return -1;
+    counts[i + 1] = next - prev;
+    prev = next;
   }
 
-  // Obtain the data
-  int books = sqlite3_column_int(command, 0);
-  sqlite3_finalize(command);
-  
-  return books;
-}
-
-/*
- * This function returns the amound of books where the time left is "critical" (today)
-*/
-int getCritical()
-{
-  // Create and execute the select-command
-  sqlite3_stmt* command;
-  if (sqlite3_prepare_v2(database, "SELECT COUNT(*) FROM books WHERE date = date('now');", -1, &command, NULL))
-  {
-    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
-
+  int all = ctx->backend->countBooks(ctx->connection, INT32_MAX);
+  if (all < 0)
     return -1;
-  }
+  counts[nthresholds + 1] = all - prev;
 
-  if (sqlite3_step(command) != SQLITE_ROW)
-  {
-    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
-
-    return -1;
-  }
+  return 0;
+}
 
-  // Obtain the data
-  int books = sqlite3_column_int(command, 0);
-  sqlite3_finalize(command);
-  
-  return books;
+int listBooks(dbcontext* ctx, int limit, void (*book)(char* title, char* url, char* date, void* data), void* data)
+{
+  return ctx->backend->listBooks(ctx->connection, limit, book, data);
 }
 
-/*
- * This function returns the amound of books where the time left is "late" (lies in the past)
-*/
-int getLate()
+int searchBooks(dbcontext* ctx, char* terms, int limit, void (*book)(char* title, char* url, char* date, void* data), void* data)
 {
-  // Create and execute the select-command
-  sqlite3_stmt* command;
-  if (sqlite3_prepare_v2(database, "SELECT COUNT(*) FROM books WHERE date < date('now');", -1, &command, NULL))
-  {
-    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+  return ctx->backend->searchBooks(ctx->connection, terms, limit, book, data);
+}
 
-    return -1;
-  }
+int needUpdate(dbcontext* ctx, int minutes)
+{
+  return ctx->backend->needUpdate(ctx->connection, minutes);
+}
 
-  if (sqlite3_step(command) != SQLITE_ROW)
-  {
-    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
+int updateDone(dbcontext* ctx, feedstats* stats)
+{
+  return ctx->backend->updateDone(ctx->connection, stats);
+}
 
-    return -1;
-  }
+int getFeedStats(dbcontext* ctx, feedstats* stats)
+{
+  return ctx->backend->getFeedStats(ctx->connection, stats);
+}
 
-  // Obtain the data
-  int books = sqlite3_column_int(command, 0);
-  sqlite3_finalize(command);
-  
-  return books;
+int maintainDatabase(dbcontext* ctx, dbstats* stats)
+{
+  return ctx->backend->maintainDatabase(ctx->connection, stats);
 }
 
 /*
- * This function checks if an update is needed (the last update was never or
- * is older than the specified amount of minutes)
+ * This function tries to become the process which updates the database db. All instances
+ * using the same database lock the file db.lock, the one getting the lock fetches the feed
+ * and the others pick up the result from the database. The lock is released by
+ * releaseUpdateLock, closeDatabase or when the process exits. Contexts of the same
+ * database in one process exclude each other as well, as they open the file each. It
+ * returns 1 if the lock was acquired, 0 if another context holds it and -1 on errors.
 */
-int needUpdate(int minutes)
+int acquireUpdateLock(dbcontext* ctx)
 {
-  // Create and execute the select-command
-  sqlite3_stmt* command;
-  int ret;
-  char sql[1024];
-  snprintf(sql, 1024, "SELECT * FROM config WHERE key='lastupdate' AND value > datetime('now', '-%i minutes');", minutes);
-  if (sqlite3_prepare_v2(database, sql, -1, &command, NULL))
+  // Nobody else can see a backend which isn't persistent
+  if (!ctx->backend->persistent)
+    return 1;
+
+  // Open the lock file once per context and keep it open
+  if (ctx->updateLock < 0)
   {
-    fprintf(stderr, "Failed to get last update, reason: %s\n", sqlite3_errmsg(database));
+    char path[1100];
+    snprintf(path, 1100, "%s.lock", ctx->db);
 
-    return -1;
+    ctx->updateLock = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (ctx->updateLock < 0)
+    {
+      fprintf(stderr, "Failed to open lock file %s\n", path);
+
+      return -1;
+    }
   }
 
-  if (sqlite3_step(command) == SQLITE_ROW) // If there is a result, we don't need to update
-    ret = 0;
-  else
-    ret = 1;
+  if (flock(ctx->updateLock, LOCK_EX | LOCK_NB))
+    return 0;
 
-  sqlite3_finalize(command);
-  
-  return ret;
+  return 1;
 }
 
 /*
- * Call this function after an update was done, it will update the lastupdate-value
+ * This function releases the lock acquired by acquireUpdateLock
 */
-int updateDone()
+void releaseUpdateLock(dbcontext* ctx)
 {
-  // Create and execute the insert-command
-  sqlite3_stmt* command;
-  if (sqlite3_prepare_v2(database, "INSERT OR REPLACE INTO config (key, value) VALUES('lastupdate', datetime('now'));", -1, &command, NULL))
-  {
-    fprintf(stderr, "Failed to update lastupdate, reason: %s\n", sqlite3_errmsg(database));
-
-    return -1;
-  }
-
-  if (sqlite3_step(command) != SQLITE_DONE)
-  {
-    fprintf(stderr, "Failed to update lastupdate, reason: %s\n", sqlite3_errmsg(database));
-    sqlite3_finalize(command);
-
-    return -1;
-  }
-
-  sqlite3_finalize(command);
-  
-  return 0;
+  if (ctx->updateLock >= 0)
+    flock(ctx->updateLock, LOCK_UN);
 }
@@ -20,18 +20,51 @@
 #ifndef _DATABASE_H
 #define _DATABASE_H
 
-int openDatabase(char* db);
-int closeDatabase(char* db);
-int beginTransaction();
-int clearBooklist();
-int addBook(char* title, char* url, char* date);
-int endTransaction();
-int abortTransaction();
-int getOk();
-int getSoon();
-int getCritical();
-int getLate();
-int needUpdate(int minutes);
-int updateDone();
+#include "booklist.h"
+#include "duedays.h"
+
+typedef struct
+{
+  long size;      // Size of the database file in bytes
+  int pages;      // Pages in the file
+  int freePages;  // Unused pages in the file
+} dbstats;
+
+/*
+ * All calls work on a context returned by openDatabase or openDatabaseReadOnly. A context
+ * must only be used by one thread at a time, threads working in parallel open a context
+ * each (of the same or of different databases).
+*/
+typedef struct dbcontext dbcontext;
+
+// Safe to call from any thread at any time
+dbcontext* openDatabase(char* storage, char* db);
+dbcontext* openDatabaseReadOnly(char* storage, char* db);
+
+// Only one thread at a time per context, the context is gone after closeDatabase
+void closeDatabase(dbcontext* ctx);
+int setBusyTimeout(dbcontext* ctx, int ms);
+int dataChanged(dbcontext* ctx);
+int beginTransaction(dbcontext* ctx);
+int clearBooklist(dbcontext* ctx);
+int addBook(dbcontext* ctx, char* title, char* url, char* date);
+int endTransaction(dbcontext* ctx);
+int abortTransaction(dbcontext* ctx);
+int getOk(dbcontext* ctx);
+int getSoon(dbcontext* ctx);
+int getCritical(dbcontext* ctx);
+int getLate(dbcontext* ctx);
+int loadDueDays(dbcontext* ctx, duedays* dd);
+int countDueBooks(dbcontext* ctx, int32_t day, int* thresholds, int nthresholds, int* counts);
+int listBooks(dbcontext* ctx, int limit, void (*book)(char* title, char* url, char* date, void* data), void* data);
+int searchBooks(dbcontext* ctx, char* terms, int limit, void (*book)(char* title, char* url, char* date, void* data), void* data);
+int needUpdate(dbcontext* ctx, int minutes);
+int updateDone(dbcontext* ctx, feedstats* stats);
+int getFeedStats(dbcontext* ctx, feedstats* stats);
+int maintainDatabase(dbcontext* ctx, dbstats* stats);
+
+// Only one thread at a time per context, contexts of the same database exclude each other
+int acquireUpdateLock(dbcontext* ctx);
+void releaseUpdateLock(dbcontext* ctx);
 
 #endif // _DATABASE_H
@@ -18,22 +18,35 @@
 */
 
 #include "dockapp.h"
+#include "xshm.h"
 #include <gai/gai.h>
+#include <stdio.h>
 #include <string.h>
 
 GaiCallback0* updatedata;
 
 GdkPixbuf* p_ok;
-GdkPixbuf* p_soon;
+GdkPixbuf* p_soon = NULL;
 GdkPixbuf* p_crit;
 GdkPixbuf* p_late;
-GdkPixbuf* n_ok = NULL;
-GdkPixbuf* n_soon = NULL;
-GdkPixbuf* n_crit = NULL;
-GdkPixbuf* n_late = NULL;
 
 int first = 1;
 
+// The "soon" row sums the buckets between the first and the last threshold, see initDockapp
+int showSoon = 1;
+
+// Drawing through the shared memory frame, see enableShm
+#define SHM_OFF 0
+#define SHM_PENDING 1
+#define SHM_ACTIVE 2
+#define SHM_ATTEMPTS 50
+int shmState = SHM_OFF;
+int shmAttempts = 0;
+
+// Every digit is rendered once per color, the numbers are composed from them
+GdkPixbuf* digits[4][10];
+int digitColors[4][3] = { { 64, 255, 64 }, { 255, 255, 64 }, { 255, 64, 64 }, { 128, 128, 128 } };
+
 /*
  * This function does preinitialization
 */
@@ -53,6 +66,79 @@ void preInit(int* argc, char** argv[])
   gai_init2(&gapp, argc, argv);
 }
 
+/*
+ * This function selects drawing through an MIT-SHM frame instead of GAI. Only the
+ * changed digits are composed and pushed to the X server. If the frame can't be set
+ * up once the dockapp is shown, drawing falls back to GAI.
+*/
+void enableShm()
+{
+  shmState = SHM_PENDING;
+}
+
+/*
+ * This function sets up the shared memory frame and draws everything that never changes
+*/
+int startShm()
+{
+  if (initShm(64, 64))
+    return -1;
+
+  shmFill(4, 4, 56, 56, 0x202020);
+  shmFill(28, 4, 1, 56, 0x000000);
+  shmDraw(p_ok, 6, 6);
+  if (showSoon)
+    shmDraw(p_soon, 6, 18);
+  shmDraw(p_crit, 6, 30);
+  shmDraw(p_late, 6, 42);
+
+  return 0;
+}
+
+/*
+ * This function composes a number from the digits of the given color into the frame
+*/
+void shmNumber(int value, int color, int y)
+{
+  char buf[16];
+  char* pos;
+  int x = 32;
+
+  shmFill(32, y, 27, 12, 0x202020);
+
+  snprintf(buf, 16, "%i", value);
+  for (pos = buf; *pos; pos++)
+  {
+    if ((*pos < '0') || (*pos > '9'))
+      continue;
+
+    GdkPixbuf* digit = digits[color][*pos - '0'];
+    shmDraw(digit, x, y);
+    x += gdk_pixbuf_get_width(digit);
+  }
+}
+
+/*
+ * This function draws a number from the digits of the given color through GAI
+*/
+void gaiNumber(int value, int color, int y)
+{
+  char buf[16];
+  char* pos;
+  int x = 32;
+
+  snprintf(buf, 16, "%i", value);
+  for (pos = buf; *pos; pos++)
+  {
+    if ((*pos < '0') || (*pos > '9'))
+      continue;
+
+    GdkPixbuf* digit = digits[color][*pos - '0'];
+    gai_draw(digit, 0, 0, gdk_pixbuf_get_width(digit), gdk_pixbuf_get_height(digit), x, y);
+    x += gdk_pixbuf_get_width(digit);
+  }
+}
+
 /*
  * This function calls the update-callback to get the data and then draws the dockapp
 */
@@ -75,53 +161,57 @@ gboolean redraw(gpointer data)
     gdk_pixbuf_unref(div);
     gai_draw_update_bg();
 
-    // The first time, the numbers are created in any case
+    // The first time, the numbers are drawn in any case
     updated = 1;
     first = 0;
   }
 
-  // Recreate number buffers if the numbers actually changed
-  if (updated == 1)
+  // Switch to the shared memory frame as soon as the windows are shown
+  if (shmState == SHM_PENDING)
+  {
+    if (!startShm())
+    {
+      shmState = SHM_ACTIVE;
+      updated = 1;
+    }
+    else if (++shmAttempts == SHM_ATTEMPTS)
+    {
+      fprintf(stderr, "XShm is not available, drawing through GAI\n");
+      shmState = SHM_OFF;
+    }
+  }
+
+  // Only the changed numbers are composed, shmFlush sends nothing if nothing changed and
+  // pushes the damage with a later redraw while the server still reads the last frame
+  if (shmState == SHM_ACTIVE)
   {
-    char buf[128];
-
-    if (n_ok != NULL)
-      gdk_pixbuf_unref(n_ok);
-    memset(buf, 0, 128);
-    snprintf(buf, 128, "%i", bd.ok);
-    n_ok = gai_text_create(buf, "Courier New", 8, GAI_TEXT_NORMAL, 64, 255, 64);
-
-    if (n_soon != NULL)
-      gdk_pixbuf_unref(n_soon);
-    memset(buf, 0, 128);
-    snprintf(buf, 128, "%i", bd.soon);
-    n_soon = gai_text_create(buf, "Courier New", 8, GAI_TEXT_NORMAL, 255, 255, 64);
-
-    if (n_crit != NULL)
-      gdk_pixbuf_unref(n_crit);
-    memset(buf, 0, 128);
-    snprintf(buf, 128, "%i", bd.crit);
-    n_crit = gai_text_create(buf, "Courier New", 8, GAI_TEXT_NORMAL, 255, 64, 64);
-
-    if (n_late != NULL)
-      gdk_pixbuf_unref(n_late);
-    memset(buf, 0, 128);
-    snprintf(buf, 128, "%i", bd.late);
-    n_late = gai_text_create(buf, "Courier New", 8, GAI_TEXT_NORMAL, 128, 128, 128);
+    if (updated == 1)
+    {
+      shmNumber(bd.ok, 0, 6);
+      if (showSoon)
+        shmNumber(bd.soon, 1, 18);
+      shmNumber(bd.crit, 2, 30);
+      shmNumber(bd.late, 3, 42);
+    }
+    shmFlush();
+
+    return 1;
   }
 
   // TODO: Find a way to get the text on the background w/o having ugly transparency issues
   //       That way we could drastically reduce update intervals
   gai_draw(p_ok, 0, 0, gdk_pixbuf_get_width(p_ok), gdk_pixbuf_get_height(p_ok), 6, 6);
-  gai_draw(p_soon, 0, 0, gdk_pixbuf_get_width(p_soon), gdk_pixbuf_get_height(p_soon), 6, 18);
+  if (showSoon)
+    gai_draw(p_soon, 0, 0, gdk_pixbuf_get_width(p_soon), gdk_pixbuf_get_height(p_soon), 6, 18);
   gai_draw(p_crit, 0, 0, gdk_pixbuf_get_width(p_crit), gdk_pixbuf_get_height(p_crit), 6, 30);
   gai_draw(p_late, 0, 0, gdk_pixbuf_get_width(p_late), gdk_pixbuf_get_height(p_late), 6, 42);
 
-  // Draw the numbers
-  gai_draw(n_ok, 0, 0, gdk_pixbuf_get_width(n_ok), gdk_pixbuf_get_height(n_ok), 32, 6);
-  gai_draw(n_soon, 0, 0, gdk_pixbuf_get_width(n_soon), gdk_pixbuf_get_height(n_soon), 32, 18);
-  gai_draw(n_crit, 0, 0, gdk_pixbuf_get_width(n_crit), gdk_pixbuf_get_height(n_crit), 32, 30);
-  gai_draw(n_late, 0, 0, gdk_pixbuf_get_width(n_late), gdk_pixbuf_get_height(n_late), 32, 42);
+  // Draw the numbers, nothing is allocated for them
+  gaiNumber(bd.ok, 0, 6);
+  if (showSoon)
+    gaiNumber(bd.soon, 1, 18);
+  gaiNumber(bd.crit, 2, 30);
+  gaiNumber(bd.late, 3, 42);
 
   gai_draw_update();
 
@@ -131,16 +221,69 @@ gboolean redraw(gpointer data)
 /*
  * This function prepares the window, draws the background and sets all the other stuff up
 */
-int initDockapp(GaiCallback0 update)
+int initDockapp(GaiCallback0 update, int* thresholds, int nthresholds)
 {
+  char buf[16];
+  int i, j;
+
   gai_background_set(64, 64, 64, TRUE);
   gai_signal_on_update(redraw, 100, 0);
   updatedata = update;
 
+  // The labels show the first and the last threshold as "due in less than N days" (the
+  // threshold + 1, a book due in threshold days still counts). With only one threshold
+  // there are no buckets between them, so the "soon" row is left out.
+  showSoon = nthresholds > 1;
   p_ok = gai_text_create("Ok:", "Courier New", 8, GAI_TEXT_NORMAL, 64, 255, 64);
-  p_soon = gai_text_create("<5:", "Courier New", 8, GAI_TEXT_NORMAL, 255, 255, 64);
-  p_crit = gai_text_create("<1:", "Courier New", 8, GAI_TEXT_NORMAL, 255, 64, 64);
+  if (showSoon)
+  {
+    snprintf(buf, 16, "<%i:", thresholds[nthresholds - 1] + 1);
+    p_soon = gai_text_create(buf, "Courier New", 8, GAI_TEXT_NORMAL, 255, 255, 64);
+  }
+  snprintf(buf, 16, "<%i:", thresholds[0] + 1);
+  p_crit = gai_text_create(buf, "Courier New", 8, GAI_TEXT_NORMAL, 255, 64, 64);
   p_late = gai_text_create("Lt:", "Courier New", 8, GAI_TEXT_NORMAL, 160, 160, 160);
+
+  for (i = 0; i < 4; i++)
+  {
+    for (j = 0; j < 10; j++)
+    {
+      char digit[2] = { '0' + j, 0 };
+      digits[i][j] = gai_text_create(digit, "Courier New", 8, GAI_TEXT_NORMAL, digitColors[i][0], digitColors[i][1], digitColors[i][2]);
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * This function releases the shared memory frame and the pixbufs, call it before the
+ * dockapp exits
+*/
+void closeDockapp()
+{
+  int i, j;
+
+  if (shmState == SHM_ACTIVE)
+    closeShm();
+  shmState = SHM_OFF;
+
+  for (i = 0; i < 4; i++)
+  {
+    for (j = 0; j < 10; j++)
+    {
+      if (digits[i][j] != NULL)
+        gdk_pixbuf_unref(digits[i][j]);
+      digits[i][j] = NULL;
+    }
+  }
+
+  gdk_pixbuf_unref(p_ok);
+  if (p_soon != NULL)
+    gdk_pixbuf_unref(p_soon);
+  gdk_pixbuf_unref(p_crit);
+  gdk_pixbuf_unref(p_late);
+  p_soon = NULL;
 }
 
 /*
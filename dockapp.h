@@ -20,6 +20,7 @@
 #ifndef _DOCKAPP_H
 #define _DOCKAPP_H
 
+#include "duedays.h"
 #include <gai/gai.h>
 
 typedef struct 
@@ -28,10 +29,15 @@ typedef struct
   int soon;
   int crit;
   int late;
+  int nbuckets;                     // Amount of valid entries in buckets
+  int buckets[MAX_THRESHOLDS + 2];  // All bucket counts, as returned by countBuckets
 } bookdata;
 
 void preInit(int* argc, char** argv[]);
-int initDockapp(GaiCallback0 func);
+void enableShm();
+gboolean redraw(gpointer data);
+int initDockapp(GaiCallback0 func, int* thresholds, int nthresholds);
 void launchDockapp();
+void closeDockapp();
 
 #endif // _DOCKAPP_H
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "duedays.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * This function initializes an empty due-day array
+*/
+void initDueDays(duedays* dd)
+{
+  dd->days = NULL;
+  dd->count = 0;
+  dd->size = 0;
+}
+
+/*
+ * This function frees the memory held by a due-day array
+*/
+void freeDueDays(duedays* dd)
+{
+  free(dd->days);
+  initDueDays(dd);
+}
+
+/*
+ * This function empties the due-day array but keeps its memory for reuse
+*/
+void clearDueDays(duedays* dd)
+{
+  dd->count = 0;
+}
+
+/*
+ * This function appends a due day to the array. Call sortDueDays after the last
+ * day was added, the counting functions rely on the array being sorted.
+*/
+int addDueDay(duedays* dd, int32_t day)
+{
+  // Grow the array if it is full
+  if (dd->count == dd->size)
+  {
+    int size = dd->size ? dd->size * 2 : 64;
+    int32_t* days = realloc(dd->days, size * sizeof(int32_t));
+    if (days == NULL)
+    {
+      fprintf(stderr, "Failed to allocate memory for due days\n");
+
+      return -1;
+    }
+
+    dd->days = days;
+    dd->size = size;
+  }
+
+  dd->days[dd->count++] = day;
+
+  return 0;
+}
+
+int compareDays(const void* a, const void* b)
+{
+  int32_t x = *(const int32_t*)a;
+  int32_t y = *(const int32_t*)b;
+
+  return (x > y) - (x < y);
+}
+
+/*
+ * This function sorts the due-day array. Days are usually delivered in order already,
+ * so the sort is skipped if that is the case.
+*/
+void sortDueDays(duedays* dd)
+{
+  int i;
+  for (i = 1; i < dd->count; i++)
+  {
+    if (dd->days[i - 1] > dd->days[i])
+    {
+      qsort(dd->days, dd->count, sizeof(int32_t), compareDays);
+      return;
+    }
+  }
+}
+
+/*
+ * This function returns the current day in the same format as the due days (UTC, like
+ * the date('now') used by the database)
+*/
+int32_t today()
+{
+  return (int32_t)(time(NULL) / 86400);
+}
+
+/*
+ * This function converts a date into days since 1970-01-01
+*/
+int32_t daysFromCivil(int y, int m, int d)
+{
+  y -= m <= 2;
+  int era = (y >= 0 ? y : y - 399) / 400;
+  int yoe = y - era * 400;
+  int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+  return era * 146097 + doe - 719468;
+}
+
+/*
+ * This function converts days since 1970-01-01 into a date
+*/
+void civilFromDays(int32_t z, int* y, int* m, int* d)
+{
+  z += 719468;
+  int era = (z >= 0 ? z : z - 146096) / 146097;
+  int doe = z - era * 146097;
+  int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int mp = (5 * doy + 2) / 153;
+
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = mp < 10 ? mp + 3 : mp - 9;
+  *y = yoe + era * 400 + (*m <= 2);
+}
+
+/*
+ * This function returns the amount of days in the array which are smaller than day
+*/
+int lowerBound(duedays* dd, int32_t day)
+{
+  int lo = 0;
+  int hi = dd->count;
+
+  while (lo < hi)
+  {
+    int mid = lo + (hi - lo) / 2;
+    if (dd->days[mid] < day)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/*
+ * This function sorts the books into buckets relative to the given day. The thresholds
+ * must be ascending and are given in days, counts must have room for nthresholds+2 entries:
+ *   counts[0]             books which are late (due before day)
+ *   counts[i+1]           books due after the previous threshold and within thresholds[i] days
+ *   counts[nthresholds+1] books due after the last threshold
+ * With the thresholds 0 and 5 this yields late, today, soon and ok. Every boundary costs a
+ * single binary search.
+*/
+int countBuckets(duedays* dd, int32_t day, int* thresholds, int nthresholds, int* counts)
+{
+  int i;
+  int prev = lowerBound(dd, day);
+
+  counts[0] = prev;
+  for (i = 0; i < nthresholds; i++)
+  {
+    int next = lowerBound(dd, day + thresholds[i] + 1);
+    counts[i + 1] = next - prev;
+    prev = next;
+  }
+  counts[nthresholds + 1] = dd->count - prev;
+
+  return 0;
+}
+
+/*
+ * This function parses a comma-separated list of ascending thresholds (e.g. "0,2,5,14")
+ * and returns the amount of thresholds or -1 if the list is invalid
+*/
+int parseThresholds(char* spec, int* thresholds)
+{
+  int n = 0;
+  char* pos = spec;
+
+  while (*pos)
+  {
+    char* end;
+    long value = strtol(pos, &end, 10);
+
+    if ((end == pos) || (value < 0) || (value > 3650) || (n == MAX_THRESHOLDS))
+      return -1;
+    if ((n > 0) && (value <= thresholds[n - 1]))
+      return -1;
+
+    thresholds[n++] = (int)value;
+
+    if (*end == ',')
+      end++;
+    else if (*end != 0)
+      return -1;
+    pos = end;
+  }
+
+  return n ? n : -1;
+}
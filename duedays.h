@@ -0,0 +1,47 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _DUEDAYS_H
+#define _DUEDAYS_H
+
+#include <stdint.h>
+
+// Maximum number of user-configurable bucket thresholds
+#define MAX_THRESHOLDS 8
+
+// Sorted, packed array of due dates, counted in days since 1970-01-01 (UTC)
+typedef struct
+{
+  int32_t* days;
+  int count;
+  int size;
+} duedays;
+
+void initDueDays(duedays* dd);
+void freeDueDays(duedays* dd);
+void clearDueDays(duedays* dd);
+int addDueDay(duedays* dd, int32_t day);
+void sortDueDays(duedays* dd);
+int32_t today();
+int32_t daysFromCivil(int y, int m, int d);
+void civilFromDays(int32_t z, int* y, int* m, int* d);
+int countBuckets(duedays* dd, int32_t day, int* thresholds, int nthresholds, int* counts);
+int parseThresholds(char* spec, int* thresholds);
+
+#endif // _DUEDAYS_H
@@ -0,0 +1,389 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fetcher.h"
+#include "booklist.h"
+#include "writer.h"
+#include "resources.h"
+#include <dlfcn.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Fetching and parsing the feed (booklist.c with curl and libxml2) is built as a module,
+ * which is only loaded while an update runs. The dockapp itself only carries the rendering
+ * and the database. The settings of a fetcher are kept here and handed to the module for
+ * every update.
+*/
+
+#define FETCH_MODULE "wmslub-fetch.so"
+
+// Unloading the module has to give back at least this much memory (KiB), see unloadModule
+#define MODULE_MIN_RECLAIM 1024
+
+typedef struct
+{
+  void* handle;
+  void (*initList)();
+  void (*cleanupList)();
+  listcontext* (*newListContext)();
+  void (*freeListContext)(listcontext* ctx);
+  void (*setPaging)(listcontext* ctx, char* param, int window);
+  void (*setTimeBudget)(listcontext* ctx, int seconds);
+  void (*setFastScan)(listcontext* ctx, int enabled);
+  void (*cancelUpdate)(listcontext* ctx);
+  int (*updateList)(listcontext* ctx, char* url, booksink* output);
+  int (*benchParsers)(int count);
+} fetchmodule;
+
+// The module is loaded once for all fetchers running an update, see loadModule
+pthread_mutex_t moduleLock = PTHREAD_MUTEX_INITIALIZER;
+int moduleUsers = 0;
+int moduleResident = 0;
+fetchmodule module;
+
+struct fetcher
+{
+  booksink sink;
+
+  // Settings handed to the module
+  char* param;
+  int window;
+  int budget;
+  int scan;
+
+  // The context of the running update and the cancels looking at it, see cancelFetch
+  listcontext* _Atomic running;
+  atomic_int cancelling;
+
+  // The thread running the update started by startFetch
+  pthread_t thread;
+  int started;
+  char url[1024];
+};
+
+/*
+ * The books go to the writer thread
+*/
+int sinkBegin(void* data)
+{
+  return writeBegin(data);
+}
+
+int sinkBook(void* data, char* title, char* url, char* date)
+{
+  return writeBook(data, title, url, date);
+}
+
+int sinkEnd(void* data, int commit, feedstats* stats)
+{
+  return writeEnd(data, commit, stats);
+}
+
+/*
+ * This function creates a fetcher handing the books to the writer output, it returns NULL
+ * on errors
+*/
+fetcher* newFetcher(writer* output)
+{
+  fetcher* f = calloc(1, sizeof(fetcher));
+  if (f == NULL)
+  {
+    fprintf(stderr, "Failed to allocate memory for the fetcher\n");
+
+    return NULL;
+  }
+
+  f->sink.data = output;
+  f->sink.begin = sinkBegin;
+  f->sink.book = sinkBook;
+  f->sink.end = sinkEnd;
+  f->window = 1;
+  atomic_init(&f->running, NULL);
+  atomic_init(&f->cancelling, 0);
+
+  return f;
+}
+
+/*
+ * This function frees a fetcher, an update started by startFetch is waited for
+*/
+void freeFetcher(fetcher* f)
+{
+  waitFetch(f);
+  free(f);
+}
+
+void setFetchPaging(fetcher* f, char* param, int window)
+{
+  f->param = param;
+  f->window = window;
+}
+
+void setFetchBudget(fetcher* f, int seconds)
+{
+  f->budget = seconds;
+}
+
+void setFetchScan(fetcher* f, int enabled)
+{
+  f->scan = enabled;
+}
+
+/*
+ * This function cancels a running update, it may be called from signal handlers. The
+ * context of the update is not freed while a cancel looks at it.
+*/
+void cancelFetch(fetcher* f)
+{
+  atomic_fetch_add(&f->cancelling, 1);
+
+  listcontext* list = atomic_load(&f->running);
+  if (list != NULL)
+    module.cancelUpdate(list);
+
+  atomic_fetch_sub(&f->cancelling, 1);
+}
+
+/*
+ * This function looks up a symbol of the module, it returns NULL on errors
+*/
+void* moduleSymbol(char* name)
+{
+  void* symbol = dlsym(module.handle, name);
+  if (symbol == NULL)
+    fprintf(stderr, "Failed to find %s in the fetch module, reason: %s\n", name, dlerror());
+
+  return symbol;
+}
+
+/*
+ * This function opens the module from the directory of the executable (or the library
+ * path) and looks up its entry points. It returns 0 on success or -1 on errors.
+*/
+int openModule()
+{
+  char path[PATH_MAX];
+  ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+
+  module.handle = NULL;
+  if (length > 0)
+  {
+    path[length] = 0;
+    char* slash = strrchr(path, '/');
+    if ((slash != NULL) && (slash - path + strlen(FETCH_MODULE) + 2 < sizeof(path)))
+    {
+      strcpy(slash + 1, FETCH_MODULE);
+      module.handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    }
+  }
+
+  if (module.handle == NULL)
+    module.handle = dlopen(FETCH_MODULE, RTLD_NOW | RTLD_LOCAL);
+  if (module.handle == NULL)
+  {
+    fprintf(stderr, "Failed to load %s, reason: %s\n", FETCH_MODULE, dlerror());
+
+    return -1;
+  }
+
+  module.initList = moduleSymbol("initList");
+  module.cleanupList = moduleSymbol("cleanupList");
+  module.newListContext = moduleSymbol("newListContext");
+  module.freeListContext = moduleSymbol("freeListContext");
+  module.setPaging = moduleSymbol("setPaging");
+  module.setTimeBudget = moduleSymbol("setTimeBudget");
+  module.setFastScan = moduleSymbol("setFastScan");
+  module.cancelUpdate = moduleSymbol("cancelUpdate");
+  module.updateList = moduleSymbol("updateList");
+  module.benchParsers = moduleSymbol("benchParsers");
+  if (!module.initList || !module.cleanupList || !module.newListContext || !module.freeListContext ||
+      !module.setPaging || !module.setTimeBudget || !module.setFastScan || !module.cancelUpdate ||
+      !module.updateList || !module.benchParsers)
+  {
+    dlclose(module.handle);
+    module.handle = NULL;
+
+    return -1;
+  }
+
+  module.initList();
+
+  return 0;
+}
+
+/*
+ * This function loads the module if no other fetcher uses it yet. It returns 0 on success
+ * or -1 on errors.
+*/
+int loadModule()
+{
+  int res = 0;
+
+  pthread_mutex_lock(&moduleLock);
+  // A resident module stays open between the updates
+  if (module.handle == NULL)
+    res = openModule();
+  if (!res)
+    moduleUsers++;
+  pthread_mutex_unlock(&moduleLock);
+
+  return res;
+}
+
+/*
+ * This function unloads the module after the last fetcher is done with it, everything
+ * curl and libxml2 allocated globally is freed before. Whether that gives back memory
+ * depends on the libraries (e.g. OpenSSL stays loaded anyway), so the first unload is
+ * measured. If it reclaimed less than MODULE_MIN_RECLAIM, the module stays loaded from
+ * the next update on and the updates save loading and initializing it.
+*/
+void unloadModule()
+{
+  resources before;
+  resources after;
+
+  pthread_mutex_lock(&moduleLock);
+  if ((--moduleUsers == 0) && !moduleResident)
+  {
+    int measured = !sampleResources(&before);
+
+    module.cleanupList();
+    dlclose(module.handle);
+    module.handle = NULL;
+
+    if (measured && !sampleResources(&after))
+    {
+      moduleResident = before.rss - after.rss < MODULE_MIN_RECLAIM;
+#ifdef DEBUG
+      fprintf(stderr, "Unloading the fetch module gave back %li KiB%s\n", before.rss - after.rss,
+              moduleResident ? ", keeping it loaded from now on" : "");
+#endif
+    }
+  }
+  pthread_mutex_unlock(&moduleLock);
+}
+
+/*
+ * This function loads the module, runs an update (see updateList) and unloads the module
+ * again. Like updateList it always ends the snapshot of the writer.
+*/
+int fetchList(fetcher* f, char* url)
+{
+  if (loadModule())
+  {
+    f->sink.end(f->sink.data, 0, NULL);
+    return -1;
+  }
+
+  listcontext* list = module.newListContext();
+  if (list == NULL)
+  {
+    f->sink.end(f->sink.data, 0, NULL);
+    unloadModule();
+
+    return -1;
+  }
+
+  module.setPaging(list, f->param, f->window);
+  if (f->budget > 0)
+    module.setTimeBudget(list, f->budget);
+  module.setFastScan(list, f->scan);
+
+  atomic_store(&f->running, list);
+  int res = module.updateList(list, url, &f->sink);
+  atomic_store(&f->running, NULL);
+
+  // Cancels from other threads may still look at the context
+  while (atomic_load(&f->cancelling))
+    sched_yield();
+
+  module.freeListContext(list);
+  unloadModule();
+
+  return res;
+}
+
+/*
+ * This is the main function of the thread started by startFetch
+*/
+void* fetchMain(void* data)
+{
+  fetcher* f = data;
+
+  fetchList(f, f->url);
+
+  return NULL;
+}
+
+/*
+ * This function runs an update (see fetchList) in a thread of the fetcher and returns
+ * right away, so the transfers never block the GLib main loop. The writer notifies the
+ * main loop once the update is done. It returns 0 if the update was started or -1 on
+ * errors, no notification follows in that case.
+*/
+int startFetch(fetcher* f, char* url)
+{
+  // The previous update has already been handed to the writer, its thread only cleans up
+  waitFetch(f);
+
+  strncpy(f->url, url, 1023);
+  f->url[1023] = 0;
+  if (pthread_create(&f->thread, NULL, fetchMain, f))
+  {
+    fprintf(stderr, "Failed to start the fetch thread\n");
+
+    return -1;
+  }
+  f->started = 1;
+
+  return 0;
+}
+
+/*
+ * This function waits for the update started by startFetch, if there is one
+*/
+void waitFetch(fetcher* f)
+{
+  if (!f->started)
+    return;
+
+  pthread_join(f->thread, NULL);
+  f->started = 0;
+}
+
+/*
+ * This function loads the module and compares the feed parsers, see benchParsers
+*/
+int benchFetch(int count)
+{
+  if (loadModule())
+    return -1;
+
+  int res = module.benchParsers(count);
+  unloadModule();
+
+  return res;
+}
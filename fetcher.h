@@ -0,0 +1,43 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FETCHER_H
+#define _FETCHER_H
+
+#include "writer.h"
+
+typedef struct fetcher fetcher;
+
+// Safe to call from any thread, fetchers run their updates in parallel to each other
+fetcher* newFetcher(writer* output);
+int benchFetch(int count);
+
+// Only one thread at a time per fetcher
+void freeFetcher(fetcher* f);
+void setFetchPaging(fetcher* f, char* param, int window);
+void setFetchBudget(fetcher* f, int seconds);
+void setFetchScan(fetcher* f, int enabled);
+int fetchList(fetcher* f, char* url);
+int startFetch(fetcher* f, char* url);
+void waitFetch(fetcher* f);
+
+// Safe to call from any thread and from signal handlers, also while fetchList runs
+void cancelFetch(fetcher* f);
+
+#endif // _FETCHER_H
@@ -17,45 +17,270 @@
  * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include "booklist.h"
+#include "fetcher.h"
 #include "database.h"
 #include "dockapp.h"
+#include "reminders.h"
+#include "resources.h"
+#include "stress.h"
+#include "writer.h"
 #include <sys/stat.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <time.h>
 
 char url[1024];
 char db[1024];
+char* storageName = "sqlite";
+dbcontext* database = NULL;
+writer* output = NULL;
+fetcher* feed = NULL;
+int thresholds[MAX_THRESHOLDS] = { 0, 5 };
+int nthresholds = 2;
+char* pagingParam = NULL;
+int pagingWindow = 4;
+int timeBudget = 0;
+int fastScan = 0;
+volatile sig_atomic_t quit = 0;
+int notifications = 0;
+duedays dd;
+int reload = 1;
+int refreshing = 0;
+bookdata shown;
+double refreshStart;
+
+// Answers --query, built from query.c
+#define QUERY_EXECUTABLE "wmslub-query"
+
+// Soak mode: amount of cycles to run and the allowed growth after the warmup
+#define SOAK_MAX_RSS 1024     // KiB
+#define SOAK_MAX_FDS 0
+#define SOAK_MAX_SQLITE 256   // KiB
+int soakCycles = 0;
+int soakCycle = 0;
+resources soakBase;
+
+/*
+ * This function returns a monotonic timestamp in milliseconds
+*/
+double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * This function is called on SIGINT and SIGTERM. A running update is cancelled and
+ * the dockapp quits on its next redraw.
+*/
+void terminate(int sig)
+{
+  quit = 1;
+  if (feed != NULL)
+    cancelFetch(feed);
+}
+
+/*
+ * This function is called by the writer thread (in the main context) when an update is finished,
+ * the bytes it transferred are recorded in the database (see getFeedStats)
+*/
+gboolean committed(gpointer result)
+{
+  refreshing = 0;
+  releaseUpdateLock(database);
+
+#ifdef DEBUG
+  feedstats fs;
+  if (getFeedStats(database, &fs) == 0)
+    fprintf(stderr, "Refresh %s after %.1f ms, %zu bytes transferred, %zu bytes decoded\n",
+            GPOINTER_TO_INT(result) ? "committed" : "failed", now() - refreshStart, fs.wireBytes, fs.feedBytes);
+#endif
+
+  return FALSE;
+}
 
 gboolean update(gpointer userdata)
 {
-  int update = 0;
+  int i;
+
+  // Shut down cleanly, the writer rolls back a cancelled update before it stops
+  if (quit)
+  {
+    waitFetch(feed);
+    stopWriter(output);
+    closeDatabase(database);
+    closeDockapp();
+    exit(0);
+  }
 
-  // Update booklist if that is needed
-  if (needUpdate(10) == 1)
+  // Update booklist if that is needed and no update is being written right now. Only one
+  // instance on the same database fetches the feed, the others see the result through
+  // dataChanged. The update may have been done while waiting for the lock.
+  if (!soakCycles && !refreshing && (needUpdate(database, 10) == 1) && (acquireUpdateLock(database) == 1))
   {
-    updateList(url);
-    updateDone();
-    update = 1;
+    if (needUpdate(database, 10) == 1)
+    {
+      refreshing = 1;
+      refreshStart = now();
+      if (startFetch(feed, url))
+      {
+        // Nothing will be committed, try again on the next tick
+        refreshing = 0;
+        releaseUpdateLock(database);
+      }
+
+      // Fetching and parsing run in the fetch thread, report how long the main loop was held anyway
+#ifdef DEBUG
+      fprintf(stderr, "Refresh blocked the main loop for %.1f ms\n", now() - refreshStart);
+#endif
+    }
+    else
+      releaseUpdateLock(database);
+  }
+
+  // Only reload the due dates after they changed (by any process), counting them is cheap
+  if (dataChanged(database) == 1)
+    reload = 1;
+  if (reload)
+  {
+    // The database may be locked by a commit, keep the numbers shown and retry on the next tick
+    if (loadDueDays(database, &dd))
+      return 0;
+
+    reload = 0;
+    if (notifications)
+      syncReminders(database);
   }
 
   bookdata* bd = (bookdata*)userdata;
-  bd->ok = getOk();
-  bd->soon = getSoon();
-  bd->crit = getCritical();
-  bd->late = getLate();
-  return update;
+  bd->nbuckets = nthresholds + 2;
+  countBuckets(&dd, today(), thresholds, nthresholds, bd->buckets);
+  bd->late = bd->buckets[0];
+  bd->crit = bd->buckets[1];
+  bd->soon = 0;
+  for (i = 2; i <= nthresholds; i++)
+    bd->soon += bd->buckets[i];
+  bd->ok = bd->buckets[nthresholds + 1];
+
+  // Report a change if the numbers differ from the ones shown (e.g. after midnight)
+  if ((bd->ok == shown.ok) && (bd->soon == shown.soon) && (bd->crit == shown.crit) && (bd->late == shown.late))
+    return 0;
+
+  shown = *bd;
+  return 1;
+}
+
+/*
+ * This function runs one cycle of the soak test: refresh, wait for the commit and redraw.
+ * It samples the resources used and exits once all cycles are done, with a failure if
+ * they grew by more than allowed after the warmup.
+*/
+gboolean soak(gpointer data)
+{
+  resources res;
+  feedstats fs;
+
+  // Wait for the writer to finish the current refresh
+  if (refreshing)
+    return TRUE;
+
+  redraw(NULL);
+  soakCycle++;
+
+  if ((soakCycle % 100 == 0) || (soakCycle == soakCycles / 10 + 1) || (soakCycle == soakCycles))
+  {
+    if (sampleResources(&res) || getFeedStats(database, &fs))
+      exit(1);
+
+    printf("%i: rss %li KiB, %i fds, sqlite %li KiB, feed %zu bytes (%zu decoded)\n", soakCycle, res.rss, res.fds,
+           res.sqlite, fs.wireBytes, fs.feedBytes);
+
+    // The first tenth of the cycles is the warmup, measure growth from there on
+    if (soakCycle == soakCycles / 10 + 1)
+      soakBase = res;
+  }
+
+  if (soakCycle == soakCycles)
+  {
+    int failed = (res.rss - soakBase.rss > SOAK_MAX_RSS) ||
+                 (res.fds - soakBase.fds > SOAK_MAX_FDS) ||
+                 (res.sqlite - soakBase.sqlite > SOAK_MAX_SQLITE);
+
+    printf("Soak %s: rss %+li KiB, %+i fds, sqlite %+li KiB\n", failed ? "failed" : "passed",
+           res.rss - soakBase.rss, res.fds - soakBase.fds, res.sqlite - soakBase.sqlite);
+    waitFetch(feed);
+    stopWriter(output);
+    closeDatabase(database);
+    closeDockapp();
+    exit(failed);
+  }
+
+  // Like update(), the refresh holds the update lock until committed() releases it. While
+  // another instance refreshes the database, the cycle goes without a refresh.
+  if (acquireUpdateLock(database) == 1)
+  {
+    refreshing = !startFetch(feed, url);
+    if (!refreshing)
+      releaseUpdateLock(database);
+  }
+
+  return TRUE;
+}
+
+/*
+ * This function replaces the process by the query tool from the directory of the
+ * executable (or the path), which reads the database without loading GTK. It only
+ * returns on errors.
+*/
+int execQuery(char* argv[])
+{
+  char path[PATH_MAX];
+  ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+
+  argv[0] = QUERY_EXECUTABLE;
+  if (length > 0)
+  {
+    path[length] = 0;
+    char* slash = strrchr(path, '/');
+    if ((slash != NULL) && (slash - path + strlen(QUERY_EXECUTABLE) + 2 < sizeof(path)))
+    {
+      strcpy(slash + 1, QUERY_EXECUTABLE);
+      execv(path, argv);
+    }
+  }
+
+  execvp(QUERY_EXECUTABLE, argv);
+  fprintf(stderr, "Failed to start %s\n", QUERY_EXECUTABLE);
+
+  return 1;
 }
 
 void printUsage()
 {
-  printf("Usage: wmslub -u <RSS-URL> [-d <DB-File>]\n");
+  printf("Usage: wmslub -u <RSS-URL> [-d <DB-File>] [-b <Days,Days,...>] [-p <Page-Param> [-w <Pages>]] [-t <Seconds>] [-f] [-m] [-n] [-s <Cycles>] [-x]\n");
+  printf("       wmslub --query [-d <DB-File>] [-b <Days,Days,...>] [-l <Books>] [-s <Terms>] [-j]\n");
+  printf("       wmslub --stress [-t <Threads>] [-r <Rounds>] [-m] [-u <RSS-URL>]\n");
+  printf("       wmslub --bench <Items>\n");
 }
 
 int main(int argc, char* argv[])
 {
+  // Queries are answered by their own executable, see query.c
+  if ((argc > 1) && !strcmp(argv[1], "--query"))
+    return execQuery(argv + 1);
+
+  // So are the stress test and the comparison of the feed parsers
+  if ((argc > 1) && !strcmp(argv[1], "--stress"))
+    return runStress(argc - 1, argv + 1);
+  if ((argc == 3) && !strcmp(argv[1], "--bench"))
+    return benchFetch(atoi(argv[2])) ? 1 : 0;
+
   // Preinitialization of dockapp
   preInit(&argc, &argv);
 
@@ -66,7 +291,7 @@ int main(int argc, char* argv[])
   memset(db, 0, 1024);
 
   int opt;
-  while ((opt = getopt(argc, argv, "u:d:")) != -1)
+  while ((opt = getopt(argc, argv, "u:d:b:p:w:t:fmns:x")) != -1)
   {
     switch (opt)
     {
@@ -78,6 +303,48 @@ int main(int argc, char* argv[])
       strncpy(db, optarg, 1023);
       hasDB = 1;
       break;
+    case 'b':
+      nthresholds = parseThresholds(optarg, thresholds);
+      if (nthresholds < 0)
+      {
+        fprintf(stderr, "Invalid thresholds %s, expected ascending days like 0,5\n", optarg);
+        exit(1);
+      }
+      break;
+    case 'p':
+      pagingParam = optarg;
+      break;
+    case 'w':
+      pagingWindow = atoi(optarg);
+      break;
+    case 't':
+      if (atoi(optarg) < 1)
+      {
+        fprintf(stderr, "The time budget must be at least one second\n");
+        exit(1);
+      }
+      timeBudget = atoi(optarg);
+      break;
+    case 'f':
+      fastScan = 1;
+      break;
+    case 'm':
+      storageName = "memory";
+      break;
+    case 'n':
+      notifications = 1;
+      break;
+    case 's':
+      soakCycles = atoi(optarg);
+      if (soakCycles < 10)
+      {
+        fprintf(stderr, "A soak test needs at least 10 cycles\n");
+        exit(1);
+      }
+      break;
+    case 'x':
+      enableShm();
+      break;
     default:
       printUsage();
       exit(1);
@@ -96,14 +363,45 @@ int main(int argc, char* argv[])
     strcat(db, "/.wmslub.db");
   }
 
-  // Try to open the database
-  if (openDatabase(db))
+  signal(SIGINT, terminate);
+  signal(SIGTERM, terminate);
+
+  // Try to open the database, writes are done by their own thread. This connection never
+  // waits for locks, reads finding the database busy are retried on the next tick.
+  database = openDatabase(storageName, db);
+  if (database == NULL)
+    return 1;
+
+  output = startWriter(storageName, db, committed);
+  if (output == NULL)
+    return 1;
+
+  // The feed is fetched by the module, which hands the books to the writer
+  feed = newFetcher(output);
+  if (feed == NULL)
     return 1;
+  setFetchPaging(feed, pagingParam, pagingWindow);
+  if (timeBudget > 0)
+    setFetchBudget(feed, timeBudget);
+  setFetchScan(feed, fastScan);
 
   // Init dockapp
-  initDockapp(update);
+  initDueDays(&dd);
+  if (notifications)
+    initReminders(thresholds[nthresholds - 1]);
+  initDockapp(update, thresholds, nthresholds);
+
+  // The soak test runs inside the normal main loop, so the dockapp is exercised as usual
+  if (soakCycles)
+    g_idle_add(soak, NULL);
 
   launchDockapp();
 
+  closeDockapp();
+  waitFetch(feed);
+  stopWriter(output);
+  freeFetcher(feed);
+  closeDatabase(database);
+
   return 0;
 }
@@ -0,0 +1,839 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "storage.h"
+#include "duedays.h"
+#include "titlewords.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct
+{
+  char* title;
+  char* url;
+  char date[11];
+  int32_t day;
+} memorybook;
+
+typedef struct
+{
+  memorybook** books;
+  int count;
+  int size;
+} memorylist;
+
+// A word of a title, see buildIndex
+typedef struct
+{
+  char* word;   // Folded by splitTitle, points into the text of the index
+  int book;     // Position of the book in the list
+} memoryword;
+
+// The words of all titles, sorted for prefix lookups
+typedef struct
+{
+  memoryword* words;
+  int count;
+  char* text;
+} memoryindex;
+
+// A book matching a search, see memorySearchBooks
+typedef struct
+{
+  int book;
+  int whole;    // Terms matching a whole word
+} memorymatch;
+
+#define MAX_TERMS 32
+
+/*
+ * The committed books of a database are shared by all its connections and protected by
+ * the lock of the store, they are kept sorted by their due day. A transaction works on a
+ * private list, which replaces the shared one when it is committed. The list is only
+ * copied if books are added without clearing it first, the writer always clears it. The
+ * stores are found by the name of the database in memoryStores.
+*/
+typedef struct memorystore
+{
+  char* name;
+  int opened;
+  pthread_mutex_t lock;
+  memorylist books;
+  memoryindex index;
+  int version;
+  time_t lastUpdate;
+  feedstats feed;       // Bytes of the last update
+  struct memorystore* next;
+} memorystore;
+
+typedef struct
+{
+  memorystore* store;
+  memorylist staged;
+  int inTransaction;
+  int staging;          // The transaction changed the books, staged holds all of them
+  int seenVersion;
+} memoryconn;
+
+pthread_mutex_t memoryStoresLock = PTHREAD_MUTEX_INITIALIZER;
+memorystore* memoryStores = NULL;
+
+/*
+ * This function frees all books of a list
+*/
+void freeList(memorylist* list)
+{
+  int i;
+
+  for (i = 0; i < list->count; i++)
+    free(list->books[i]);
+  free(list->books);
+
+  list->books = NULL;
+  list->count = 0;
+  list->size = 0;
+}
+
+/*
+ * This function appends a copy of a book to a list
+*/
+int appendBook(memorylist* list, char* title, char* url, char* date, int32_t day)
+{
+  size_t lt = strlen(title) + 1;
+  size_t lu = url ? strlen(url) + 1 : 0;
+
+  if (list->count == list->size)
+  {
+    int size = list->size ? list->size * 2 : 64;
+    memorybook** books = realloc(list->books, size * sizeof(memorybook*));
+    if (books == NULL)
+    {
+      fprintf(stderr, "Failed to insert book, reason: out of memory\n");
+
+      return -1;
+    }
+
+    list->books = books;
+    list->size = size;
+  }
+
+  memorybook* book = malloc(sizeof(memorybook) + lt + lu);
+  if (book == NULL)
+  {
+    fprintf(stderr, "Failed to insert book, reason: out of memory\n");
+
+    return -1;
+  }
+
+  book->title = memcpy((char*)(book + 1), title, lt);
+  book->url = url ? memcpy((char*)(book + 1) + lt, url, lu) : NULL;
+  strncpy(book->date, date, 10);
+  book->date[10] = 0;
+  book->day = day;
+  list->books[list->count++] = book;
+
+  return 0;
+}
+
+/*
+ * This function orders the books by their due day, then by title and link like the
+ * sqlite storage does
+*/
+int compareBooks(const void* a, const void* b)
+{
+  const memorybook* x = *(memorybook* const*)a;
+  const memorybook* y = *(memorybook* const*)b;
+  int res;
+
+  if (x->day != y->day)
+    return (x->day > y->day) - (x->day < y->day);
+  if ((res = strcmp(x->title, y->title)))
+    return res;
+
+  return strcmp(x->url ? x->url : "", y->url ? y->url : "");
+}
+
+int compareMatches(const void* a, const void* b)
+{
+  const memorymatch* x = a;
+  const memorymatch* y = b;
+
+  return (x->whole != y->whole) ? y->whole - x->whole : x->book - y->book;
+}
+
+int compareWords(const void* a, const void* b)
+{
+  const memoryword* x = a;
+  const memoryword* y = b;
+  int res = strcmp(x->word, y->word);
+
+  return res ? res : x->book - y->book;
+}
+
+/*
+ * This function builds the index of the words of all titles of the sorted list. It
+ * returns 0 on success or -1 on errors.
+*/
+int buildIndex(memorylist* list, memoryindex* index)
+{
+  size_t length = 1;
+  size_t longest = 0;
+  char** words;
+  char* pos;
+  int i, j;
+
+  for (i = 0; i < list->count; i++)
+  {
+    size_t lt = strlen(list->books[i]->title) + 1;
+    length += lt;
+    if (lt > longest)
+      longest = lt;
+  }
+
+  // A title of n bytes has at most (n + 1) / 2 words
+  index->count = 0;
+  index->text = malloc(length);
+  index->words = malloc((length / 2 + 1) * sizeof(memoryword));
+  words = malloc((longest / 2 + 1) * sizeof(char*));
+  if ((index->text == NULL) || (index->words == NULL) || (words == NULL))
+  {
+    fprintf(stderr, "Failed to index titles, reason: out of memory\n");
+    free(index->text);
+    free(index->words);
+    free(words);
+
+    return -1;
+  }
+
+  pos = index->text;
+  for (i = 0; i < list->count; i++)
+  {
+    size_t lt = strlen(list->books[i]->title) + 1;
+    int n;
+
+    memcpy(pos, list->books[i]->title, lt);
+    n = splitTitle(pos, words, longest / 2 + 1);
+    for (j = 0; j < n; j++)
+    {
+      index->words[index->count].word = words[j];
+      index->words[index->count].book = i;
+      index->count++;
+    }
+    pos += lt;
+  }
+  free(words);
+
+  qsort(index->words, index->count, sizeof(memoryword), compareWords);
+
+  return 0;
+}
+
+void freeIndex(memoryindex* index)
+{
+  free(index->words);
+  free(index->text);
+  index->words = NULL;
+  index->text = NULL;
+  index->count = 0;
+}
+
+/*
+ * This function opens the memory storage, all connections to the same db share the books
+*/
+void* memoryOpenDatabase(char* db)
+{
+  memorystore* store;
+
+  memoryconn* conn = calloc(1, sizeof(memoryconn));
+  if (conn == NULL)
+  {
+    fprintf(stderr, "Failed to open database %s, reason: out of memory\n", db);
+
+    return NULL;
+  }
+  conn->seenVersion = -1;
+
+  pthread_mutex_lock(&memoryStoresLock);
+  for (store = memoryStores; (store != NULL) && strcmp(store->name, db); store = store->next);
+
+  if (store == NULL)
+  {
+    store = calloc(1, sizeof(memorystore));
+    if ((store == NULL) || ((store->name = strdup(db)) == NULL))
+    {
+      pthread_mutex_unlock(&memoryStoresLock);
+      fprintf(stderr, "Failed to open database %s, reason: out of memory\n", db);
+      free(store);
+      free(conn);
+
+      return NULL;
+    }
+
+    pthread_mutex_init(&store->lock, NULL);
+    store->next = memoryStores;
+    memoryStores = store;
+  }
+
+  store->opened++;
+  pthread_mutex_unlock(&memoryStoresLock);
+
+  conn->store = store;
+  return conn;
+}
+
+/*
+ * This function closes the memory storage, the books are gone after the last close
+*/
+void memoryCloseDatabase(void* connection)
+{
+  memoryconn* conn = connection;
+  memorystore* store = conn->store;
+  memorystore** pos;
+
+  if (conn->inTransaction)
+    freeList(&conn->staged);
+  free(conn);
+
+  pthread_mutex_lock(&memoryStoresLock);
+  if (--store->opened == 0)
+  {
+    for (pos = &memoryStores; *pos != store; pos = &(*pos)->next);
+    *pos = store->next;
+
+    freeList(&store->books);
+    freeIndex(&store->index);
+    pthread_mutex_destroy(&store->lock);
+    free(store->name);
+    free(store);
+  }
+  pthread_mutex_unlock(&memoryStoresLock);
+}
+
+/*
+ * There are no locks held for long, so there is nothing to wait for
+*/
+int memorySetBusyTimeout(void* connection, int ms)
+{
+  return 0;
+}
+
+/*
+ * This function returns 1 if a transaction was committed by another connection since the
+ * last call on the same connection, like data_version of SQLite
+*/
+int memoryDataChanged(void* connection)
+{
+  memoryconn* conn = connection;
+
+  pthread_mutex_lock(&conn->store->lock);
+  int version = conn->store->version;
+  pthread_mutex_unlock(&conn->store->lock);
+
+  if (version == conn->seenVersion)
+    return 0;
+
+  conn->seenVersion = version;
+  return 1;
+}
+
+/*
+ * This function starts a transaction, the books are copied by the first change that needs
+ * them (see stageBooks)
+*/
+int memoryBeginTransaction(void* connection)
+{
+  memoryconn* conn = connection;
+
+  if (conn->inTransaction)
+  {
+    fprintf(stderr, "Failed to start transaction, reason: a transaction is already running\n");
+
+    return -1;
+  }
+
+  conn->inTransaction = 1;
+  conn->staging = 0;
+  return 0;
+}
+
+/*
+ * This function copies the committed books into the transaction, unless it has its own
+ * list already
+*/
+int stageBooks(memoryconn* conn)
+{
+  memorylist* books = &conn->store->books;
+  int i;
+  int ret = 0;
+
+  if (conn->staging)
+    return 0;
+
+  pthread_mutex_lock(&conn->store->lock);
+  for (i = 0; (i < books->count) && !ret; i++)
+  {
+    memorybook* book = books->books[i];
+    ret = appendBook(&conn->staged, book->title, book->url, book->date, book->day);
+  }
+  pthread_mutex_unlock(&conn->store->lock);
+
+  if (ret)
+  {
+    freeList(&conn->staged);
+
+    return -1;
+  }
+
+  conn->staging = 1;
+  return 0;
+}
+
+/*
+ * This function makes the books of the transaction visible to all connections
+*/
+int memoryEndTransaction(void* connection)
+{
+  memoryconn* conn = connection;
+  memorylist old;
+  memoryindex index;
+  memoryindex oldIndex;
+
+  if (!conn->inTransaction)
+  {
+    fprintf(stderr, "Failed to commit transaction, reason: no transaction is running\n");
+
+    return -1;
+  }
+
+  // Nothing changed
+  if (!conn->staging)
+  {
+    conn->inTransaction = 0;
+
+    return 0;
+  }
+
+  qsort(conn->staged.books, conn->staged.count, sizeof(memorybook*), compareBooks);
+
+  // The index refers to positions in the sorted list
+  if (buildIndex(&conn->staged, &index) != 0)
+    return -1;
+
+  pthread_mutex_lock(&conn->store->lock);
+  old = conn->store->books;
+  oldIndex = conn->store->index;
+  conn->store->books = conn->staged;
+  conn->store->index = index;
+
+  // The own commit isn't reported as change, the ones missed before still are
+  if (conn->seenVersion == conn->store->version)
+    conn->seenVersion++;
+  conn->store->version++;
+  pthread_mutex_unlock(&conn->store->lock);
+
+  freeList(&old);
+  freeIndex(&oldIndex);
+  conn->staged.books = NULL;
+  conn->staged.count = 0;
+  conn->staged.size = 0;
+  conn->inTransaction = 0;
+  conn->staging = 0;
+
+  return 0;
+}
+
+/*
+ * This function drops the books of the transaction
+*/
+int memoryAbortTransaction(void* connection)
+{
+  memoryconn* conn = connection;
+
+  if (!conn->inTransaction)
+  {
+    fprintf(stderr, "Failed to roll back transaction, reason: no transaction is running\n");
+
+    return -1;
+  }
+
+  freeList(&conn->staged);
+  conn->inTransaction = 0;
+  conn->staging = 0;
+
+  return 0;
+}
+
+/*
+ * This function removes all books, outside of a transaction it runs in its own
+*/
+int memoryClearBooklist(void* connection)
+{
+  memoryconn* conn = connection;
+
+  if (!conn->inTransaction)
+    return memoryBeginTransaction(conn) || memoryClearBooklist(conn) || memoryEndTransaction(conn);
+
+  // The committed books aren't needed any more, the new list starts empty
+  freeList(&conn->staged);
+  conn->staging = 1;
+
+  return 0;
+}
+
+/*
+ * This function adds a book, the date has to be given as YYYY-MM-DD. Outside of a
+ * transaction it runs in its own.
+*/
+int memoryAddBook(void* connection, char* title, char* url, char* date)
+{
+  memoryconn* conn = connection;
+  int y, m, d;
+  char normalized[16];
+
+  if ((title == NULL) || (date == NULL) || (sscanf(date, "%4d-%2d-%2d", &y, &m, &d) != 3) ||
+      (m < 1) || (m > 12) || (d < 1) || (d > 31))
+  {
+    fprintf(stderr, "Failed to insert book, reason: invalid book\n");
+
+    return -1;
+  }
+
+  if (!conn->inTransaction)
+    return memoryBeginTransaction(conn) || memoryAddBook(conn, title, url, date) || memoryEndTransaction(conn);
+
+  // Days past the end of the month roll over into the next one, like in SQLite
+  int32_t day = daysFromCivil(y, m, d);
+  civilFromDays(day, &y, &m, &d);
+  snprintf(normalized, 16, "%04d-%02d-%02d", y, m, d);
+
+  if (stageBooks(conn))
+    return -1;
+
+  return appendBook(&conn->staged, title, url, normalized, day);
+}
+
+/*
+ * This function counts the committed books due in the range of days [from, to]
+*/
+int countDays(memoryconn* conn, int32_t from, int32_t to)
+{
+  memorylist* books = &conn->store->books;
+  int i;
+  int count = 0;
+
+  pthread_mutex_lock(&conn->store->lock);
+  for (i = 0; i < books->count; i++)
+    if ((books->books[i]->day >= from) && (books->books[i]->day <= to))
+      count++;
+  pthread_mutex_unlock(&conn->store->lock);
+
+  return count;
+}
+
+int memoryGetOk(void* connection)
+{
+  return countDays(connection, today() + 6, INT32_MAX);
+}
+
+int memoryGetSoon(void* connection)
+{
+  return countDays(connection, today() + 1, today() + 5);
+}
+
+int memoryGetCritical(void* connection)
+{
+  return countDays(connection, today(), today());
+}
+
+int memoryGetLate(void* connection)
+{
+  return countDays(connection, INT32_MIN, today() - 1);
+}
+
+/*
+ * This function loads the due days of all books, they are already sorted
+*/
+int memoryLoadDueDays(void* connection, duedays* dd)
+{
+  memoryconn* conn = connection;
+  memorylist* books = &conn->store->books;
+  int i;
+  int ret = 0;
+
+  clearDueDays(dd);
+
+  pthread_mutex_lock(&conn->store->lock);
+  for (i = 0; (i < books->count) && !ret; i++)
+    ret = addDueDay(dd, books->books[i]->day);
+  pthread_mutex_unlock(&conn->store->lock);
+
+  return ret;
+}
+
+/*
+ * This function counts the books due before the given day, the list is sorted by day
+*/
+int memoryCountBooks(void* connection, int32_t before)
+{
+  memoryconn* conn = connection;
+  memorylist* books = &conn->store->books;
+  int lo = 0;
+  int hi;
+
+  pthread_mutex_lock(&conn->store->lock);
+  hi = books->count;
+  while (lo < hi)
+  {
+    int mid = lo + (hi - lo) / 2;
+    if (books->books[mid]->day < before)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  pthread_mutex_unlock(&conn->store->lock);
+
+  return lo;
+}
+
+/*
+ * This function calls book for the limit books which are due first (all if limit is negative)
+*/
+int memoryListBooks(void* connection, int limit, void (*book)(char* title, char* url, char* date, void* data), void* data)
+{
+  memoryconn* conn = connection;
+  memorylist* books = &conn->store->books;
+  int i;
+
+  pthread_mutex_lock(&conn->store->lock);
+  for (i = 0; (i < books->count) && ((limit < 0) || (i < limit)); i++)
+    book(books->books[i]->title, books->books[i]->url, books->books[i]->date, data);
+  pthread_mutex_unlock(&conn->store->lock);
+
+  return 0;
+}
+
+/*
+ * This function calls book for the limit best books (all if limit is negative) having a
+ * word starting with each of the terms. Books matching more terms as whole words come
+ * first, then the ones which are due first. Titles and terms are split into words by
+ * splitTitle, like the full-text index of the sqlite storage does.
+*/
+int memorySearchBooks(void* connection, char* terms, int limit, void (*book)(char* title, char* url, char* date, void* data), void* data)
+{
+  memoryconn* conn = connection;
+  memorystore* store = conn->store;
+  char* words[MAX_TERMS];
+  unsigned* matched = NULL;
+  unsigned* whole = NULL;
+  unsigned all;
+  memorymatch* matches = NULL;
+  int count, found = 0;
+  int i, t;
+
+  char* text = strdup(terms);
+  if (text == NULL)
+  {
+    fprintf(stderr, "Failed to search books, reason: out of memory\n");
+
+    return -1;
+  }
+
+  count = splitTitle(text, words, MAX_TERMS);
+  if (count == 0)
+  {
+    free(text);
+
+    return 0;
+  }
+
+  pthread_mutex_lock(&store->lock);
+  if (store->books.count > 0)
+  {
+    matched = calloc(store->books.count, sizeof(unsigned));
+    whole = calloc(store->books.count, sizeof(unsigned));
+    matches = calloc(store->books.count, sizeof(memorymatch));
+  }
+  if ((store->books.count > 0) && ((matched == NULL) || (whole == NULL) || (matches == NULL)))
+  {
+    pthread_mutex_unlock(&store->lock);
+    fprintf(stderr, "Failed to search books, reason: out of memory\n");
+    free(matched);
+    free(whole);
+    free(matches);
+    free(text);
+
+    return -1;
+  }
+
+  for (t = 0; t < count; t++)
+  {
+    size_t length = strlen(words[t]);
+    int low = 0;
+    int high = store->index.count;
+
+    // Find the first word not below the term, all words having it as prefix follow
+    while (low < high)
+    {
+      int mid = low + (high - low) / 2;
+      if (strcmp(store->index.words[mid].word, words[t]) < 0)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+    for (i = low; (i < store->index.count) && !strncmp(store->index.words[i].word, words[t], length); i++)
+    {
+      int b = store->index.words[i].book;
+
+      // Only count books matching all terms before
+      if ((matched[b] & ((1u << t) - 1)) != (1u << t) - 1)
+        continue;
+
+      matched[b] |= 1u << t;
+      if (store->index.words[i].word[length] == 0)
+        whole[b] |= 1u << t;
+    }
+  }
+
+  all = (count == 32) ? ~0u : (1u << count) - 1;
+  for (i = 0; i < store->books.count; i++)
+    if (matched[i] == all)
+    {
+      matches[found].book = i;
+      matches[found++].whole = __builtin_popcount(whole[i]);
+    }
+  qsort(matches, found, sizeof(memorymatch), compareMatches);
+
+  for (i = 0; (i < found) && ((limit < 0) || (i < limit)); i++)
+  {
+    memorybook* b = store->books.books[matches[i].book];
+    book(b->title, b->url, b->date, data);
+  }
+  pthread_mutex_unlock(&store->lock);
+
+  free(matched);
+  free(whole);
+  free(matches);
+  free(text);
+
+  return 0;
+}
+
+int memoryNeedUpdate(void* connection, int minutes)
+{
+  memoryconn* conn = connection;
+
+  pthread_mutex_lock(&conn->store->lock);
+  int need = (conn->store->lastUpdate == 0) || (conn->store->lastUpdate < time(NULL) - minutes * 60);
+  pthread_mutex_unlock(&conn->store->lock);
+
+  return need;
+}
+
+int memoryUpdateDone(void* connection, feedstats* stats)
+{
+  memoryconn* conn = connection;
+
+  pthread_mutex_lock(&conn->store->lock);
+  conn->store->lastUpdate = time(NULL);
+  conn->store->feed = *stats;
+  pthread_mutex_unlock(&conn->store->lock);
+
+  return 0;
+}
+
+int memoryGetFeedStats(void* connection, feedstats* stats)
+{
+  memoryconn* conn = connection;
+
+  pthread_mutex_lock(&conn->store->lock);
+  *stats = conn->store->feed;
+  pthread_mutex_unlock(&conn->store->lock);
+
+  return 0;
+}
+
+/*
+ * This function gives back unused slots of the book list. The statistics count the
+ * slots of the list as pages.
+*/
+int memoryMaintainDatabase(void* connection, dbstats* stats)
+{
+  memoryconn* conn = connection;
+  memorylist* list = &conn->store->books;
+  int i;
+
+  pthread_mutex_lock(&conn->store->lock);
+  if ((list->size > 64) && (list->count < list->size / 4))
+  {
+    memorybook** books = realloc(list->books, list->size / 2 * sizeof(memorybook*));
+    if (books != NULL)
+    {
+      list->books = books;
+      list->size /= 2;
+    }
+  }
+
+  if (stats != NULL)
+  {
+    stats->size = list->size * sizeof(memorybook*);
+    for (i = 0; i < list->count; i++)
+    {
+      memorybook* book = list->books[i];
+      stats->size += sizeof(memorybook) + strlen(book->title) + 1 + (book->url ? strlen(book->url) + 1 : 0);
+    }
+    stats->pages = list->size;
+    stats->freePages = list->size - list->count;
+  }
+  pthread_mutex_unlock(&conn->store->lock);
+
+  return 0;
+}
+
+storage memoryStorage =
+{
+  "memory",
+  0,
+  memoryOpenDatabase,
+  memoryOpenDatabase,
+  memoryCloseDatabase,
+  memorySetBusyTimeout,
+  memoryDataChanged,
+  memoryBeginTransaction,
+  memoryClearBooklist,
+  memoryAddBook,
+  memoryEndTransaction,
+  memoryAbortTransaction,
+  memoryGetOk,
+  memoryGetSoon,
+  memoryGetCritical,
+  memoryGetLate,
+  memoryLoadDueDays,
+  memoryCountBooks,
+  memoryListBooks,
+  memorySearchBooks,
+  memoryNeedUpdate,
+  memoryUpdateDone,
+  memoryGetFeedStats,
+  memoryMaintainDatabase
+};
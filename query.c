@@ -0,0 +1,193 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "query.h"
+#include "database.h"
+#include "duedays.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int json = 0;
+int listed = 0;
+
+/*
+ * This function prints a string as JSON string literal
+*/
+void printJson(char* str)
+{
+  putchar('"');
+  for (; str && *str; str++)
+  {
+    unsigned char c = *str;
+
+    if ((c == '"') || (c == '\\'))
+      printf("\\%c", c);
+    else if (c == '\n')
+      printf("\\n");
+    else if (c == '\t')
+      printf("\\t");
+    else if (c < 0x20)
+      printf("\\u%04x", c);
+    else
+      putchar(c);
+  }
+  putchar('"');
+}
+
+/*
+ * This function prints a book of the list of books due first
+*/
+void printBook(char* title, char* url, char* date, void* data)
+{
+  if (json)
+  {
+    printf("%s{\"title\":", listed ? "," : "");
+    printJson(title);
+    printf(",\"url\":");
+    printJson(url);
+    printf(",\"date\":");
+    printJson(date);
+    putchar('}');
+  }
+  else
+    printf("%s\t%s\n", date, title);
+
+  listed++;
+}
+
+void printQueryUsage()
+{
+  printf("Usage: wmslub-query [-d <DB-File>] [-b <Days,Days,...>] [-l <Books>] [-s <Terms>] [-j]\n");
+  printf("       wmslub --query [-d <DB-File>] [-b <Days,Days,...>] [-l <Books>] [-s <Terms>] [-j]\n");
+}
+
+/*
+ * This function answers a query from the command line without starting the dockapp. It
+ * prints the amount of books per bucket (late, one per threshold, later) and optionally
+ * the books due first or the books whose titles match the search terms, as plain text or
+ * JSON. The database is only read. It runs in its own executable (wmslub-query, which
+ * wmslub --query starts), so neither GTK nor curl or libxml2 are even loaded.
+*/
+int runQuery(int argc, char* argv[])
+{
+  char db[1024];
+  int thresholds[MAX_THRESHOLDS] = { 0, 5 };
+  int nthresholds = 2;
+  int counts[MAX_THRESHOLDS + 2];
+  int limit = 0;
+  char* terms = NULL;
+  int ret;
+  int i;
+
+  memset(db, 0, 1024);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "d:b:l:s:j")) != -1)
+  {
+    switch (opt)
+    {
+    case 'd':
+      strncpy(db, optarg, 1023);
+      break;
+    case 'b':
+      nthresholds = parseThresholds(optarg, thresholds);
+      if (nthresholds < 0)
+      {
+        fprintf(stderr, "Invalid thresholds %s, expected ascending days like 0,5\n", optarg);
+        return 1;
+      }
+      break;
+    case 'l':
+      limit = atoi(optarg);
+      break;
+    case 's':
+      terms = optarg;
+      break;
+    case 'j':
+      json = 1;
+      break;
+    default:
+      printQueryUsage();
+      return 1;
+    }
+  }
+
+  if (!db[0])
+    snprintf(db, 1024, "%s/.wmslub.db", getenv("HOME"));
+
+  dbcontext* ctx = openDatabaseReadOnly("sqlite", db);
+  if (ctx == NULL)
+    return 1;
+
+  // Count the books per bucket on the date index, the due dates themselves aren't needed
+  if (countDueBooks(ctx, today(), thresholds, nthresholds, counts))
+  {
+    closeDatabase(ctx);
+    return 1;
+  }
+
+  if (json)
+  {
+    printf("{\"late\":%i,\"buckets\":[", counts[0]);
+    for (i = 0; i < nthresholds; i++)
+      printf("%s{\"days\":%i,\"count\":%i}", i ? "," : "", thresholds[i], counts[i + 1]);
+    printf("],\"later\":%i", counts[nthresholds + 1]);
+
+    // The bytes of the last update, to see how well the feed is compressed
+    feedstats fs;
+    if (getFeedStats(ctx, &fs) == 0)
+      printf(",\"feed\":{\"wire\":%zu,\"decoded\":%zu}", fs.wireBytes, fs.feedBytes);
+  }
+  else
+  {
+    for (i = 0; i < nthresholds + 2; i++)
+      printf("%s%i", i ? " " : "", counts[i]);
+    putchar('\n');
+  }
+
+  // List the matching books or the books due first
+  if ((terms != NULL) || (limit > 0))
+  {
+    if (json)
+      printf(",\"books\":[");
+
+    if (terms != NULL)
+      ret = searchBooks(ctx, terms, limit > 0 ? limit : -1, printBook, NULL);
+    else
+      ret = listBooks(ctx, limit, printBook, NULL);
+
+    if (ret)
+    {
+      closeDatabase(ctx);
+      return 1;
+    }
+
+    if (json)
+      putchar(']');
+  }
+
+  if (json)
+    printf("}\n");
+
+  closeDatabase(ctx);
+
+  return 0;
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "reminders.h"
+#include "database.h"
+#include "duedays.h"
+#include "timerwheel.h"
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define TICK_SECONDS 60
+#define MAX_WAIT 3600     // The monotonic clock stops during suspend, so check at least hourly
+
+#define EVENT_SOON 0
+#define EVENT_TODAY 1
+#define EVENT_LATE 2
+#define EVENTS 3
+
+typedef struct
+{
+  char* key;      // Link (or title) and occurrence, identifies the book across updates
+  char* title;
+  int32_t day;    // Due day the events are scheduled for
+  int seen;
+  wheeltimer events[EVENTS];
+} reminder;
+
+/*
+ * Every book has a reminder with its events on the timer wheel. Only a single GLib timer
+ * is armed, for the next tick the wheel has to be advanced to.
+*/
+timerwheel wheel;
+GHashTable* reminders = NULL;
+guint armed = 0;
+int reminderDays = 5;
+
+/*
+ * This function returns the current tick of the wheel
+*/
+uint64_t currentTick()
+{
+  return time(NULL) / TICK_SECONDS;
+}
+
+/*
+ * This function shows a desktop notification
+*/
+void notify(char* summary, char* body)
+{
+  gchar* argv[] = { "notify-send", summary, body, NULL };
+
+  if (!g_spawn_async(NULL, argv, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL, NULL, NULL, NULL, NULL))
+    fprintf(stderr, "Failed to show notification \"%s: %s\"\n", summary, body);
+}
+
+/*
+ * This function is called by the wheel when an event of a book is due
+*/
+void fireReminder(wheeltimer* timer, void* data)
+{
+  reminder* r = (reminder*)data;
+  char summary[64];
+
+  // The event may fire late, e.g. for books found at startup
+  if ((timer == &r->events[EVENT_SOON]) && (r->day - today() == 1))
+    snprintf(summary, 64, "Book due tomorrow");
+  else if (timer == &r->events[EVENT_SOON])
+    snprintf(summary, 64, "Book due in %i days", r->day - today());
+  else if (timer == &r->events[EVENT_TODAY])
+    snprintf(summary, 64, "Book due today");
+  else
+    snprintf(summary, 64, "Book overdue");
+
+  notify(summary, r->title);
+}
+
+/*
+ * This function frees a reminder and cancels its events
+*/
+void freeReminder(gpointer data)
+{
+  reminder* r = (reminder*)data;
+  int i;
+
+  for (i = 0; i < EVENTS; i++)
+    removeTimer(&wheel, &r->events[i]);
+
+  g_free(r->key);
+  g_free(r->title);
+  g_free(r);
+}
+
+gboolean wakeUp(gpointer data);
+
+/*
+ * This function arms the GLib timer for the next tick of the wheel
+*/
+void armTimer()
+{
+  uint64_t tick;
+
+  if (armed)
+    g_source_remove(armed);
+  armed = 0;
+
+  if (!nextExpiry(&wheel, &tick))
+    return;
+
+  long wait = (long)(tick * TICK_SECONDS - time(NULL));
+  if (wait < 1)
+    wait = 1;
+  if (wait > MAX_WAIT)
+    wait = MAX_WAIT;
+
+  armed = g_timeout_add_seconds(wait, wakeUp, NULL);
+}
+
+/*
+ * This function is called by GLib when the armed timer expires
+*/
+gboolean wakeUp(gpointer data)
+{
+  armed = 0;
+  advanceWheel(&wheel, currentTick());
+  armTimer();
+
+  return FALSE;
+}
+
+/*
+ * This function enables reminders, a book is announced days before it is due, on the
+ * day it is due and on the day after
+*/
+void initReminders(int days)
+{
+  reminderDays = days;
+  initWheel(&wheel, currentTick());
+  reminders = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, freeReminder);
+}
+
+/*
+ * This function schedules the events of a reminder for its due day. Events still to come
+ * are placed at the start of their day. Of the events which already passed, the latest
+ * fires once right away, so books found overdue (e.g. at startup) are announced as well.
+*/
+void scheduleReminder(reminder* r)
+{
+  uint64_t ticks[EVENTS];
+  int past = -1;
+  int i;
+
+  ticks[EVENT_SOON] = (uint64_t)(r->day - reminderDays) * 86400 / TICK_SECONDS;
+  ticks[EVENT_TODAY] = (uint64_t)r->day * 86400 / TICK_SECONDS;
+  ticks[EVENT_LATE] = (uint64_t)(r->day + 1) * 86400 / TICK_SECONDS;
+
+  for (i = 0; i < EVENTS; i++)
+  {
+    removeTimer(&wheel, &r->events[i]);
+    if ((i == EVENT_SOON) && (reminderDays <= 0))
+      continue;
+
+    if (ticks[i] >= wheel.now)
+      addTimer(&wheel, &r->events[i], ticks[i]);
+    else
+      past = i;
+  }
+
+  if (past >= 0)
+    addTimer(&wheel, &r->events[past], wheel.now);
+}
+
+/*
+ * This function is called by listBooks for every book. A book is identified by its link
+ * (or its title if it has none) and how often that occurred before in the list, so equal
+ * books get a reminder each. Only new books and books whose due date changed touch the
+ * wheel, occurrences counts the keys of the current list.
+*/
+void syncBook(char* title, char* url, char* date, void* data)
+{
+  GHashTable* occurrences = data;
+  int y, m, d;
+  int i;
+
+  if (sscanf(date, "%d-%d-%d", &y, &m, &d) != 3)
+    return;
+
+  char* base = (url != NULL) && *url ? url : title;
+  int occurrence = GPOINTER_TO_INT(g_hash_table_lookup(occurrences, base));
+  g_hash_table_insert(occurrences, g_strdup(base), GINT_TO_POINTER(occurrence + 1));
+
+  gchar* key = g_strdup_printf("%s\x1f%i", base, occurrence);
+  int32_t day = daysFromCivil(y, m, d);
+  reminder* r = g_hash_table_lookup(reminders, key);
+
+  if (r != NULL)
+  {
+    g_free(key);
+    r->seen = 1;
+
+    if (strcmp(r->title, title))
+    {
+      g_free(r->title);
+      r->title = g_strdup(title);
+    }
+
+    if (r->day != day)
+    {
+      r->day = day;
+      scheduleReminder(r);
+    }
+
+    return;
+  }
+
+  r = g_malloc0(sizeof(reminder));
+  r->key = key;
+  r->title = g_strdup(title);
+  r->day = day;
+  r->seen = 1;
+  for (i = 0; i < EVENTS; i++)
+    initTimer(&r->events[i], fireReminder, r);
+  scheduleReminder(r);
+
+  g_hash_table_insert(reminders, r->key, r);
+}
+
+/*
+ * This function drops the reminders of books that were returned
+*/
+gboolean dropUnseen(gpointer key, gpointer value, gpointer data)
+{
+  reminder* r = (reminder*)value;
+
+  if (!r->seen)
+    return TRUE;
+
+  r->seen = 0;
+  return FALSE;
+}
+
+/*
+ * This function resets the marks of dropUnseen without dropping anything
+*/
+void keepSeen(gpointer key, gpointer value, gpointer data)
+{
+  ((reminder*)value)->seen = 0;
+}
+
+/*
+ * This function brings the reminders in line with the books of the database, call it
+ * after the books changed. Updates replace the whole list of books, so it is read again,
+ * but reminders of books that didn't change are kept as they are.
+*/
+int syncReminders(dbcontext* ctx)
+{
+  if (reminders == NULL)
+    return 0;
+
+  advanceWheel(&wheel, currentTick());
+
+  GHashTable* occurrences = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  int ret = listBooks(ctx, -1, syncBook, occurrences);
+  g_hash_table_destroy(occurrences);
+
+  // Keep all reminders if the books couldn't be read completely
+  if (ret)
+  {
+    g_hash_table_foreach(reminders, keepSeen, NULL);
+    armTimer();
+
+    return -1;
+  }
+
+  g_hash_table_foreach_remove(reminders, dropUnseen, NULL);
+  armTimer();
+
+  return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "resources.h"
+#include <dirent.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+ * This function samples the resources currently used by the process. It reads
+ * /proc and therefore only works on Linux.
+*/
+int sampleResources(resources* res)
+{
+  // Resident memory, the second field of statm is given in pages
+  long size, rss;
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if (statm == NULL)
+  {
+    fprintf(stderr, "Failed to read /proc/self/statm\n");
+
+    return -1;
+  }
+
+  if (fscanf(statm, "%ld %ld", &size, &rss) != 2)
+  {
+    fprintf(stderr, "Failed to read /proc/self/statm\n");
+    fclose(statm);
+
+    return -1;
+  }
+  fclose(statm);
+  res->rss = rss * (sysconf(_SC_PAGESIZE) / 1024);
+
+  // Open file descriptors, without ., .. and the one used for reading the directory
+  DIR* fds = opendir("/proc/self/fd");
+  if (fds == NULL)
+  {
+    fprintf(stderr, "Failed to read /proc/self/fd\n");
+
+    return -1;
+  }
+
+  res->fds = -3;
+  while (readdir(fds) != NULL)
+    res->fds++;
+  closedir(fds);
+
+  res->sqlite = (long)(sqlite3_memory_used() / 1024);
+
+  return 0;
+}
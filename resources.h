@@ -0,0 +1,32 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RESOURCES_H
+#define _RESOURCES_H
+
+typedef struct
+{
+  long rss;       // Resident memory in KiB
+  int fds;        // Open file descriptors
+  long sqlite;    // Memory held by SQLite in KiB
+} resources;
+
+int sampleResources(resources* res);
+
+#endif // _RESOURCES_H
@@ -0,0 +1,517 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rssscan.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * This scanner handles the fixed format of the library feed (/rss/channel/item with
+ * title, link and description) directly on the received buffer, without building a
+ * document. Everything it doesn't expect (CDATA, comments, a DOCTYPE, markup inside the
+ * fields, other encodings, invalid UTF-8, unknown entities, next-page links) makes it give
+ * up, the feed then has to be parsed by libxml2.
+*/
+
+/*
+ * This function returns the first occurrence of c in [pos, end) or NULL, 16 bytes are
+ * compared at once if SSE2 is available
+*/
+const char* findByte(const char* pos, const char* end, char c)
+{
+#ifdef __SSE2__
+  __m128i needle = _mm_set1_epi8(c);
+
+  while (end - pos >= 16)
+  {
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)pos), needle));
+    if (mask)
+      return pos + __builtin_ctz(mask);
+    pos += 16;
+  }
+#endif
+
+  return pos < end ? memchr(pos, c, end - pos) : NULL;
+}
+
+/*
+ * This function returns the first occurrence of str in [pos, end) or NULL
+*/
+const char* findString(const char* pos, const char* end, const char* str)
+{
+  size_t length = strlen(str);
+
+  while ((pos = findByte(pos, end, str[0])) != NULL)
+  {
+    if ((size_t)(end - pos) < length)
+      return NULL;
+    if (!memcmp(pos, str, length))
+      return pos;
+    pos++;
+  }
+
+  return NULL;
+}
+
+void initItems(rssitems* items)
+{
+  items->items = NULL;
+  items->count = 0;
+  items->size = 0;
+}
+
+void freeItems(rssitems* items)
+{
+  free(items->items);
+  initItems(items);
+}
+
+/*
+ * This function returns 1 if the character is allowed in XML, which excludes surrogates,
+ * most C0 controls and U+FFFE/U+FFFF
+*/
+int allowedChar(unsigned long c)
+{
+  return (c == 0x9) || (c == 0xA) || (c == 0xD) || ((c >= 0x20) && (c <= 0xD7FF)) ||
+         ((c >= 0xE000) && (c <= 0xFFFD)) || ((c >= 0x10000) && (c <= 0x10FFFF));
+}
+
+/*
+ * This function checks a character reference like #228 or #xE4, like libxml2 it only
+ * accepts characters allowed in XML
+*/
+int numeric(const char* ref, size_t length)
+{
+  size_t digits = 1;
+  int hex = (length > 2) && (ref[1] == 'x');
+
+  if ((length < 2) || (ref[0] != '#'))
+    return 0;
+  if (hex)
+    digits++;
+
+  for (size_t i = digits; i < length; i++)
+    if (!(hex ? isxdigit((unsigned char)ref[i]) : isdigit((unsigned char)ref[i])))
+      return 0;
+
+  if (length == digits)
+    return 0;
+
+  return allowedChar(strtoul(ref + digits, NULL, hex ? 16 : 10));
+}
+
+/*
+ * This function checks that [pos, end) is valid UTF-8 of characters allowed in XML.
+ * libxml2 rejects everything else, e.g. a Latin-1 umlaut in a feed declared as UTF-8.
+*/
+int validText(const char* pos, const char* end)
+{
+  static const unsigned long shortest[] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+  while (pos < end)
+  {
+    unsigned char first = *pos;
+    unsigned long c;
+    int length, i;
+
+    if (first < 0x80)
+    {
+      if (!allowedChar(first))
+        return 0;
+      pos++;
+      continue;
+    }
+
+    if ((first & 0xE0) == 0xC0)
+      length = 2;
+    else if ((first & 0xF0) == 0xE0)
+      length = 3;
+    else if ((first & 0xF8) == 0xF0)
+      length = 4;
+    else
+      return 0;
+
+    if (end - pos < length)
+      return 0;
+
+    c = first & (0x7F >> length);
+    for (i = 1; i < length; i++)
+    {
+      if (((unsigned char)pos[i] & 0xC0) != 0x80)
+        return 0;
+      c = (c << 6) | (pos[i] & 0x3F);
+    }
+
+    // Overlong forms encode a character with more bytes than needed
+    if ((c < shortest[length]) || !allowedChar(c))
+      return 0;
+    pos += length;
+  }
+
+  return 1;
+}
+
+/*
+ * This function checks that the XML declaration between pos and declEnd announces UTF-8
+ * or no encoding at all
+*/
+int declaresUtf8(const char* pos, const char* declEnd)
+{
+  const char* encoding = findString(pos, declEnd, "encoding");
+  if (encoding == NULL)
+    return 1;
+
+  // encoding = "UTF-8", with optional blanks around the equals sign
+  pos = encoding + 8;
+  while ((pos < declEnd) && isspace((unsigned char)*pos))
+    pos++;
+  if ((pos >= declEnd) || (*pos++ != '='))
+    return 0;
+  while ((pos < declEnd) && isspace((unsigned char)*pos))
+    pos++;
+
+  if ((declEnd - pos < 7) || ((*pos != '"') && (*pos != '\'')))
+    return 0;
+
+  return !strncasecmp(pos + 1, "utf-8", 5) && (pos[6] == pos[0]);
+}
+
+/*
+ * This function checks that a field contains only text and known entities
+*/
+int plainText(view v)
+{
+  const char* end = v.data + v.length;
+  const char* pos = v.data;
+
+  if (findByte(pos, end, '<') != NULL)
+    return 0;
+
+  if (!validText(pos, end))
+    return 0;
+
+  while ((pos = findByte(pos, end, '&')) != NULL)
+  {
+    const char* semicolon = findByte(pos, end, ';');
+    if ((semicolon == NULL) || (semicolon - pos > 10))
+      return 0;
+
+    size_t length = semicolon - pos - 1;
+    if (!((length == 3 && !memcmp(pos + 1, "amp", 3)) || (length == 2 && !memcmp(pos + 1, "lt", 2)) ||
+          (length == 2 && !memcmp(pos + 1, "gt", 2)) || (length == 4 && !memcmp(pos + 1, "quot", 4)) ||
+          (length == 4 && !memcmp(pos + 1, "apos", 4)) || numeric(pos + 1, length)))
+      return 0;
+    pos = semicolon + 1;
+  }
+
+  return 1;
+}
+
+/*
+ * This function scans the children of an item, it returns 0 if it doesn't look as expected
+*/
+int scanItem(const char* pos, const char* end, rssitem* item)
+{
+  memset(item, 0, sizeof(rssitem));
+
+  while ((pos = findByte(pos, end, '<')) != NULL)
+  {
+    const char* close = findByte(pos, end, '>');
+    if ((close == NULL) || (pos[1] == '!') || (pos[1] == '?') || (pos[1] == '/'))
+      return 0;
+
+    // Empty elements have no content
+    size_t nameLength = strcspn(pos + 1, " \t\r\n/>");
+    if (close[-1] == '/')
+    {
+      pos = close + 1;
+      continue;
+    }
+
+    char endTag[64];
+    if (nameLength + 4 > sizeof(endTag))
+      return 0;
+    snprintf(endTag, sizeof(endTag), "</%.*s>", (int)nameLength, pos + 1);
+
+    const char* content = close + 1;
+    const char* contentEnd = findString(content, end, endTag);
+    if (contentEnd == NULL)
+      return 0;
+
+    view* field = NULL;
+    if ((nameLength == 5) && !memcmp(pos + 1, "title", 5))
+      field = &item->title;
+    else if ((nameLength == 4) && !memcmp(pos + 1, "link", 4))
+      field = &item->link;
+    else if ((nameLength == 11) && !memcmp(pos + 1, "description", 11))
+      field = &item->description;
+
+    // The fields must not have attributes, other elements are skipped
+    if (field != NULL)
+    {
+      if (close != pos + 1 + nameLength)
+        return 0;
+
+      if (field->data == NULL)
+      {
+        field->data = content;
+        field->length = contentEnd - content;
+        if (!plainText(*field))
+          return 0;
+      }
+    }
+    else if ((findByte(content, contentEnd, '<') != NULL) || !validText(content, contentEnd))
+      return 0;
+
+    pos = contentEnd + strlen(endTag);
+  }
+
+  return (item->title.data != NULL) && (item->link.data != NULL) && (item->description.data != NULL);
+}
+
+/*
+ * This function returns 1 if there is a link to the next page (rel="next" or rel='next')
+ * in [pos, end)
+*/
+int linksNext(const char* pos, const char* end)
+{
+  while ((pos = findString(pos, end, "rel")) != NULL)
+  {
+    pos += 3;
+
+    const char* value = pos;
+    while ((value < end) && isspace((unsigned char)*value))
+      value++;
+    if ((value >= end) || (*value++ != '='))
+      continue;
+    while ((value < end) && isspace((unsigned char)*value))
+      value++;
+
+    if ((end - value >= 6) && ((*value == '"') || (*value == '\'')) && !memcmp(value + 1, "next", 4) &&
+        (value[5] == value[0]))
+      return 1;
+  }
+
+  return 0;
+}
+
+/*
+ * This function scans a complete feed and collects the fields of all items as views into
+ * buffer. It returns the amount of items or -1 if the feed has to be parsed by libxml2.
+*/
+int scanFeed(const char* buffer, size_t length, rssitems* items)
+{
+  const char* end = buffer + length;
+  const char* pos = buffer;
+
+  items->count = 0;
+
+  // Only UTF-8 (the default) is handled
+  if ((length > 5) && !memcmp(buffer, "<?xml", 5))
+  {
+    const char* declEnd = findString(buffer, end, "?>");
+    if (declEnd == NULL)
+      return -1;
+
+    if (!declaresUtf8(buffer, declEnd))
+      return -1;
+    pos = declEnd + 2;
+  }
+
+  // Comments, CDATA and DOCTYPEs are left to libxml2
+  if (findString(pos, end, "<!") != NULL)
+    return -1;
+
+  const char* channel = findString(pos, end, "<channel");
+  if ((findString(pos, end, "<rss") == NULL) || (channel == NULL))
+    return -1;
+
+  // The last item has to be followed by the end of the channel and the feed
+  const char* channelEnd = findString(channel, end, "</channel>");
+  if ((channelEnd == NULL) || (findString(channelEnd, end, "</rss>") == NULL))
+    return -1;
+
+  // Links to further pages are only followed by libxml2, wherever they are in the channel
+  if (linksNext(channel, channelEnd))
+    return -1;
+
+  pos = findByte(channel, channelEnd, '>');
+  if (pos == NULL)
+    return -1;
+  pos++;
+
+  // Only the items that are children of the channel count, other elements are skipped
+  const char* tag;
+  while ((tag = findByte(pos, channelEnd, '<')) != NULL)
+  {
+    const char* close = findByte(tag, channelEnd, '>');
+    if ((close == NULL) || (tag[1] == '/') || (tag[1] == '?') || !validText(pos, tag))
+      return -1;
+
+    size_t nameLength = strcspn(tag + 1, " \t\r\n/>");
+    if (close[-1] == '/')
+    {
+      pos = close + 1;
+      continue;
+    }
+
+    if ((nameLength != 4) || memcmp(tag + 1, "item", 4))
+    {
+      // A nested element of the same name ends up at a stray end tag above
+      char endTag[64];
+      if (nameLength + 4 > sizeof(endTag))
+        return -1;
+      snprintf(endTag, sizeof(endTag), "</%.*s>", (int)nameLength, tag + 1);
+
+      const char* elementEnd = findString(close + 1, channelEnd, endTag);
+      if ((elementEnd == NULL) || !validText(close + 1, elementEnd))
+        return -1;
+
+      pos = elementEnd + strlen(endTag);
+      continue;
+    }
+
+    const char* itemEnd = findString(close, channelEnd, "</item>");
+    if (itemEnd == NULL)
+      return -1;
+
+    if (items->count == items->size)
+    {
+      int size = items->size ? items->size * 2 : 64;
+      rssitem* grown = realloc(items->items, size * sizeof(rssitem));
+      if (grown == NULL)
+        return -1;
+
+      items->items = grown;
+      items->size = size;
+    }
+
+    if (!scanItem(close + 1, itemEnd, &items->items[items->count]))
+      return -1;
+    items->count++;
+
+    pos = itemEnd + 7;
+  }
+
+  if (!validText(pos, channelEnd))
+    return -1;
+
+  return items->count;
+}
+
+/*
+ * This function appends a code point as UTF-8
+*/
+char* putUtf8(char* out, unsigned long c)
+{
+  if (c < 0x80)
+    *out++ = c;
+  else if (c < 0x800)
+  {
+    *out++ = 0xC0 | (c >> 6);
+    *out++ = 0x80 | (c & 0x3F);
+  }
+  else if (c < 0x10000)
+  {
+    *out++ = 0xE0 | (c >> 12);
+    *out++ = 0x80 | ((c >> 6) & 0x3F);
+    *out++ = 0x80 | (c & 0x3F);
+  }
+  else
+  {
+    *out++ = 0xF0 | (c >> 18);
+    *out++ = 0x80 | ((c >> 12) & 0x3F);
+    *out++ = 0x80 | ((c >> 6) & 0x3F);
+    *out++ = 0x80 | (c & 0x3F);
+  }
+
+  return out;
+}
+
+/*
+ * This function copies text and normalizes its line ends like XML requires, CR LF and
+ * single CRs become LF. It returns the end of the copy.
+*/
+char* copyText(char* out, const char* pos, const char* end)
+{
+  const char* cr;
+
+  while ((cr = findByte(pos, end, '\r')) != NULL)
+  {
+    memcpy(out, pos, cr - pos);
+    out += cr - pos;
+    *out++ = '\n';
+    pos = cr + 1;
+    if ((pos < end) && (*pos == '\n'))
+      pos++;
+  }
+
+  memcpy(out, pos, end - pos);
+
+  return out + (end - pos);
+}
+
+/*
+ * This function returns a copy of the field with its entities decoded and its line ends
+ * normalized, it has to be freed by the caller
+*/
+char* decodeView(view v)
+{
+  const char* pos = v.data;
+  const char* end = v.data + v.length;
+  char* str = malloc(v.length + 1);
+  char* out = str;
+
+  if (str == NULL)
+    return NULL;
+
+  while (pos < end)
+  {
+    const char* amp = findByte(pos, end, '&');
+    if (amp == NULL)
+      amp = end;
+
+    out = copyText(out, pos, amp);
+    if (amp == end)
+      break;
+
+    // The entities were checked by scanFeed
+    const char* semicolon = findByte(amp, end, ';');
+    if (amp[1] == '#')
+      out = putUtf8(out, amp[2] == 'x' ? strtoul(amp + 3, NULL, 16) : strtoul(amp + 2, NULL, 10));
+    else if (amp[1] == 'a')
+      *out++ = amp[2] == 'm' ? '&' : '\'';
+    else if (amp[1] == 'l')
+      *out++ = '<';
+    else if (amp[1] == 'g')
+      *out++ = '>';
+    else
+      *out++ = '"';
+    pos = semicolon + 1;
+  }
+  *out = 0;
+
+  return str;
+}
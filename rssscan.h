@@ -0,0 +1,51 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RSSSCAN_H
+#define _RSSSCAN_H
+
+#include <stddef.h>
+
+// A part of the feed buffer, not terminated
+typedef struct
+{
+  const char* data;
+  size_t length;
+} view;
+
+typedef struct
+{
+  view title;
+  view link;
+  view description;
+} rssitem;
+
+typedef struct
+{
+  rssitem* items;
+  int count;
+  int size;
+} rssitems;
+
+void initItems(rssitems* items);
+void freeItems(rssitems* items);
+int scanFeed(const char* buffer, size_t length, rssitems* items);
+char* decodeView(view v);
+
+#endif // _RSSSCAN_H
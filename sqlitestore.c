@@ -0,0 +1,1144 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "storage.h"
+#include "titlewords.h"
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Time to wait for other connections while creating the tables, in milliseconds
+#define OPEN_TIMEOUT 5000
+
+// Free pages are given back once they make up 1/MAINTAIN_FREE_SHARE of the file
+#define MAINTAIN_FREE_SHARE 8
+
+// Words of the search terms which are looked at, like in the memory storage
+#define MAX_TERMS 32
+
+// A connection and its change detection, see sqliteDataChanged
+typedef struct
+{
+  sqlite3* handle;
+  sqlite3_stmt* versionCommand;
+  int lastVersion;
+  int titleIndex;             // Whether books_fts exists, -1 if not checked yet
+} sqliteconn;
+
+/*
+ * This function executes a pragma (or another statement without parameters) until it
+ * is done. If value is given, it is set to the first column of the first row.
+*/
+int runPragma(sqlite3* database, char* sql, int* value)
+{
+  sqlite3_stmt* command;
+  int ret;
+
+  if (sqlite3_prepare_v2(database, sql, -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to execute %s reason: %s\n", sql, sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  if (value != NULL)
+    *value = 0;
+
+  while ((ret = sqlite3_step(command)) == SQLITE_ROW)
+  {
+    if (value != NULL)
+    {
+      *value = sqlite3_column_int(command, 0);
+      value = NULL;
+    }
+  }
+
+  if (ret != SQLITE_DONE)
+  {
+    fprintf(stderr, "Failed to execute %s reason: %s\n", sql, sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+  sqlite3_finalize(command);
+
+  return 0;
+}
+
+/*
+ * This function creates the full-text index of the titles, it is kept up to date by
+ * triggers on the books table. A new index (or one of a vacuumed database, if rebuild
+ * is given) is filled from the books. It returns 0 on success or -1 on errors.
+*/
+int createTitleIndex(sqlite3* database, int rebuild)
+{
+  int exists;
+
+  if (runPragma(database, "SELECT COUNT(*) FROM sqlite_master WHERE name = 'books_fts';", &exists))
+    return -1;
+
+  if (runPragma(database, "CREATE VIRTUAL TABLE IF NOT EXISTS books_fts USING fts5(name, content = 'books', content_rowid = 'rowid', tokenize = 'unicode61 remove_diacritics 2');", NULL) ||
+      runPragma(database, "CREATE TRIGGER IF NOT EXISTS books_fts_insert AFTER INSERT ON books BEGIN INSERT INTO books_fts (rowid, name) VALUES (new.rowid, new.name); END;", NULL) ||
+      runPragma(database, "CREATE TRIGGER IF NOT EXISTS books_fts_delete AFTER DELETE ON books BEGIN INSERT INTO books_fts (books_fts, rowid, name) VALUES ('delete', old.rowid, old.name); END;", NULL) ||
+      runPragma(database, "CREATE TRIGGER IF NOT EXISTS books_fts_update AFTER UPDATE ON books BEGIN INSERT INTO books_fts (books_fts, rowid, name) VALUES ('delete', old.rowid, old.name); INSERT INTO books_fts (rowid, name) VALUES (new.rowid, new.name); END;", NULL))
+    return -1;
+
+  if ((!exists || rebuild) && runPragma(database, "INSERT INTO books_fts (books_fts) VALUES ('rebuild');", NULL))
+    return -1;
+
+  return 0;
+}
+
+/*
+ * This function wraps an open database into a connection, it returns NULL on errors
+*/
+sqliteconn* newConnection(sqlite3* database)
+{
+  sqliteconn* conn = calloc(1, sizeof(sqliteconn));
+  if (conn == NULL)
+  {
+    fprintf(stderr, "Failed to allocate memory for the connection\n");
+    sqlite3_close(database);
+
+    return NULL;
+  }
+
+  conn->handle = database;
+  conn->lastVersion = -1;
+  conn->titleIndex = -1;
+
+  return conn;
+}
+
+/*
+ * This function will create/open the database given in the parameter db.
+ * It will create all the neccessary tables if they don't yet exist. This
+ * function must be called and it's success verified before using any other
+ * functions of this library. It returns the connection or NULL on errors.
+*/
+void* sqliteOpenDatabase(char* db)
+{
+  sqlite3* database = NULL;
+
+  // Create/Open the database
+  if (sqlite3_open_v2(db, &database, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK)
+  {
+    fprintf(stderr, "Failed to open database %s, reason: %s\n", db, sqlite3_errmsg(database));
+    sqlite3_close(database);
+
+    return NULL;
+  }
+
+  // Connections opened at the same time wait for each other
+  sqlite3_busy_timeout(database, OPEN_TIMEOUT);
+
+  // Free pages are given back by maintainDatabase, which also converts existing databases
+  if (runPragma(database, "PRAGMA auto_vacuum = INCREMENTAL;", NULL))
+  {
+    sqlite3_close(database);
+
+    return NULL;
+  }
+
+  // Create the neccessary tables if they don't exist
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "CREATE TABLE IF NOT EXISTS books (name string not null, url string, date string not null);", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to create books-table, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_close(database);
+
+    return NULL;
+  }
+
+  if (sqlite3_step(command) != SQLITE_DONE)
+  {
+    fprintf(stderr, "Failed to create books-table, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+    sqlite3_close(database);
+
+    return NULL;
+  }
+  sqlite3_finalize(command);
+
+  if (sqlite3_prepare_v2(database, "CREATE TABLE IF NOT EXISTS config (key string unique, value string);", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to create config-table, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_close(database);
+
+    return NULL;
+  }
+
+  if (sqlite3_step(command) != SQLITE_DONE)
+  {
+    fprintf(stderr, "Failed to create config-table, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+    sqlite3_close(database);
+
+    return NULL;
+  }
+  sqlite3_finalize(command);
+
+  // Books are always looked up by their date
+  if (sqlite3_prepare_v2(database, "CREATE INDEX IF NOT EXISTS books_date ON books (date);", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to create date index, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_close(database);
+
+    return NULL;
+  }
+
+  if (sqlite3_step(command) != SQLITE_DONE)
+  {
+    fprintf(stderr, "Failed to create date index, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+    sqlite3_close(database);
+
+    return NULL;
+  }
+  sqlite3_finalize(command);
+
+  // Titles are searched through a full-text index, without FTS5 they are scanned
+  if (createTitleIndex(database, 0))
+    fprintf(stderr, "Full-text search is not available, titles are searched without index\n");
+
+  // Database successfully initialized
+  sqlite3_busy_timeout(database, 0);
+  return newConnection(database);
+}
+
+/*
+ * This function opens the existing database db for reading only. Nothing is created,
+ * so it is cheap enough for one-shot queries.
+*/
+void* sqliteOpenDatabaseReadOnly(char* db)
+{
+  sqlite3* database = NULL;
+
+  if (sqlite3_open_v2(db, &database, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+  {
+    fprintf(stderr, "Failed to open database %s, reason: %s\n", db, sqlite3_errmsg(database));
+    sqlite3_close(database);
+
+    return NULL;
+  }
+
+  return newConnection(database);
+}
+
+/*
+ * This function sets how long the database waits for locks held by other connections.
+ * By default it fails immediately.
+*/
+int sqliteSetBusyTimeout(void* connection, int ms)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  if (sqlite3_busy_timeout(database, ms) != SQLITE_OK)
+  {
+    fprintf(stderr, "Failed to set busy timeout, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * This function starts a transaction on the database. Make sure that you finish
+ * this transaction by calling endTransaction of abortTransaction. If the return
+ * value is not 0, the transaction has to be assumed as not started.
+*/
+int sqliteBeginTransaction(void* connection)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create and execute begin transaction command
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "BEGIN EXCLUSIVE;", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to start transaction, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  if (sqlite3_step(command) != SQLITE_DONE)
+  {
+    fprintf(stderr, "Failed to start transaction, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+  sqlite3_finalize(command);
+  
+  return 0;
+}
+
+/*
+ * This function will close the database, call at the end of the program before exiting.
+*/
+void sqliteCloseDatabase(void* connection)
+{
+  sqliteconn* conn = connection;
+
+  sqlite3_finalize(conn->versionCommand);
+  sqlite3_close(conn->handle);
+  free(conn);
+}
+
+/*
+ * This function returns 1 if the books might have changed since the last call on the
+ * same connection, 0 if they didn't and -1 on errors. Only commits of other connections
+ * (e.g. the writer thread or another instance) are seen, the data_version doesn't change
+ * for the connection's own writes. A check costs a single pragma, so it can be called on
+ * every redraw.
+*/
+int sqliteDataChanged(void* connection)
+{
+  sqliteconn* conn = connection;
+  sqlite3* database = conn->handle;
+  int changed = 0;
+
+  // The pragma is prepared once and reused
+  if (conn->versionCommand == NULL)
+  {
+    if (sqlite3_prepare_v2(database, "PRAGMA data_version;", -1, &conn->versionCommand, NULL))
+    {
+      fprintf(stderr, "Failed to get data version, reason: %s\n", sqlite3_errmsg(database));
+      conn->versionCommand = NULL;
+
+      return -1;
+    }
+  }
+
+  int ret = sqlite3_step(conn->versionCommand);
+  if (ret != SQLITE_ROW)
+  {
+    // A busy database is not worth a message, the caller just tries again
+    if (ret != SQLITE_BUSY)
+      fprintf(stderr, "Failed to get data version, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_reset(conn->versionCommand);
+
+    return -1;
+  }
+
+  int version = sqlite3_column_int(conn->versionCommand, 0);
+  sqlite3_reset(conn->versionCommand);
+
+  if (version != conn->lastVersion)
+    changed = 1;
+  conn->lastVersion = version;
+
+  return changed;
+}
+
+/*
+ * This function will clear the contents of the table books. It should be called when
+ * updating the list of books from the datasource. You should start a transaction
+ * before calling this function to ensure you can rollback to the previous state in case
+ * something goes wrong during data retrieval.
+*/
+int sqliteClearBooklist(void* connection)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create and execute delete command
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "DELETE FROM books;", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to clear booklist, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  if (sqlite3_step(command) != SQLITE_DONE)
+  {
+    fprintf(stderr, "Failed to clear booklist, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+  sqlite3_finalize(command);
+  
+  return 0;
+}
+
+/*
+ * This function will add a book to the books-table.
+*/
+int sqliteAddBook(void* connection, char* title, char* url, char* date)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create, bind and execute the insert command
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "INSERT INTO books (name, url, date) VALUES(?, ?, date(?));", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to insert book, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  if (sqlite3_bind_text(command, 1, title, -1, SQLITE_STATIC))
+  {
+    fprintf(stderr, "Failed to insert book, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+
+  if (sqlite3_bind_text(command, 2, url, -1, SQLITE_STATIC))
+  {
+    fprintf(stderr, "Failed to insert book, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+
+  if (sqlite3_bind_text(command, 3, date, -1, SQLITE_STATIC))
+  {
+    fprintf(stderr, "Failed to insert book, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+
+  if (sqlite3_step(command) != SQLITE_DONE)
+  {
+    fprintf(stderr, "Failed to insert book, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+  sqlite3_finalize(command);
+  
+  return 0;
+}
+
+/*
+ * This function ends a transaction on the database. The changes done in the transaction
+ * will be commited.
+*/
+int sqliteEndTransaction(void* connection)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create and execute end transaction command
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "COMMIT;", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to commit transaction, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  if (sqlite3_step(command) != SQLITE_DONE)
+  {
+    fprintf(stderr, "Failed to commit transaction, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+  sqlite3_finalize(command);
+  
+  return 0;
+}
+
+/*
+ * This function ends a transaction on the database. The changes done in the transaction
+ * will be rolled back.
+*/
+int sqliteAbortTransaction(void* connection)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create and execute rollback transaction command
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "ROLLBACK;", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to roll back transaction, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  if (sqlite3_step(command) != SQLITE_DONE)
+  {
+    fprintf(stderr, "Failed to roll back transaction, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+  sqlite3_finalize(command);
+  
+  return 0;
+}
+
+/*
+ * This function returns the amound of books where the time left is "Ok" (>5 days)
+*/
+int sqliteGetOk(void* connection)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create and execute the select-command
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "SELECT COUNT(*) FROM books WHERE date > date('now', '+5 day');", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  if (sqlite3_step(command) != SQLITE_ROW)
+  {
+    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+
+  // Obtain the data
+  int books = sqlite3_column_int(command, 0);
+  sqlite3_finalize(command);
+  
+  return books;
+}
+
+/*
+ * This function returns the amound of books where the time left is "Soon" (not today but <=5days)
+*/
+int sqliteGetSoon(void* connection)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create and execute the select-command
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "SELECT COUNT(*) FROM books WHERE date <= date('now', '+5 day') AND date > date('now');", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  if (sqlite3_step(command) != SQLITE_ROW)
+  {
+    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+
+  // Obtain the data
+  int books = sqlite3_column_int(command, 0);
+  sqlite3_finalize(command);
+  
+  return books;
+}
+
+/*
+ * This function returns the amound of books where the time left is "critical" (today)
+*/
+int sqliteGetCritical(void* connection)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create and execute the select-command
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "SELECT COUNT(*) FROM books WHERE date = date('now');", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  if (sqlite3_step(command) != SQLITE_ROW)
+  {
+    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+
+  // Obtain the data
+  int books = sqlite3_column_int(command, 0);
+  sqlite3_finalize(command);
+  
+  return books;
+}
+
+/*
+ * This function returns the amound of books where the time left is "late" (lies in the past)
+*/
+int sqliteGetLate(void* connection)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create and execute the select-command
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "SELECT COUNT(*) FROM books WHERE date < date('now');", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  if (sqlite3_step(command) != SQLITE_ROW)
+  {
+    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+
+  // Obtain the data
+  int books = sqlite3_column_int(command, 0);
+  sqlite3_finalize(command);
+  
+  return books;
+}
+
+/*
+ * This function counts the books due before the given day (days since 1970-01-01) through
+ * the date index, or all books if before is INT32_MAX
+*/
+int sqliteCountBooks(void* connection, int32_t before)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create and execute the select-command
+  sqlite3_stmt* command;
+  char* sql = "SELECT COUNT(*) FROM books WHERE date < date(?, 'unixepoch');";
+  if (before == INT32_MAX)
+    sql = "SELECT COUNT(*) FROM books;";
+
+  if (sqlite3_prepare_v2(database, sql, -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to count books, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  if (before != INT32_MAX)
+    sqlite3_bind_int64(command, 1, (sqlite3_int64)before * 86400);
+
+  if (sqlite3_step(command) != SQLITE_ROW)
+  {
+    fprintf(stderr, "Failed to count books, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+
+  int books = sqlite3_column_int(command, 0);
+  sqlite3_finalize(command);
+
+  return books;
+}
+
+/*
+ * This function loads the due dates of all books into dd, as days since 1970-01-01.
+ * The array is sorted afterwards and can be counted with countBuckets.
+*/
+int sqliteLoadDueDays(void* connection, duedays* dd)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create and execute the select-command
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "SELECT CAST(julianday(date) - 2440587.5 AS INTEGER) FROM books ORDER BY date;", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to get due dates, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  // Obtain the data
+  int ret;
+  clearDueDays(dd);
+  while ((ret = sqlite3_step(command)) == SQLITE_ROW)
+  {
+    if (addDueDay(dd, sqlite3_column_int(command, 0)))
+    {
+      sqlite3_finalize(command);
+
+      return -1;
+    }
+  }
+
+  if (ret != SQLITE_DONE)
+  {
+    if (ret != SQLITE_BUSY)
+      fprintf(stderr, "Failed to get due dates, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+  sqlite3_finalize(command);
+  sortDueDays(dd);
+
+  return 0;
+}
+
+/*
+ * This function calls book for the limit books which are due first (all books if limit
+ * is negative), ordered by their date
+*/
+int sqliteListBooks(void* connection, int limit, void (*book)(char* title, char* url, char* date, void* data), void* data)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create, bind and execute the select-command
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "SELECT name, url, date FROM books ORDER BY date, name, url LIMIT ?;", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  if (sqlite3_bind_int(command, 1, limit))
+  {
+    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+
+  // Obtain the data
+  int ret;
+  while ((ret = sqlite3_step(command)) == SQLITE_ROW)
+    book((char*)sqlite3_column_text(command, 0), (char*)sqlite3_column_text(command, 1), (char*)sqlite3_column_text(command, 2), data);
+
+  if (ret != SQLITE_DONE)
+  {
+    fprintf(stderr, "Failed to get books, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+  sqlite3_finalize(command);
+
+  return 0;
+}
+
+/*
+ * This function turns the words of the search terms (see splitTitle) into a full-text
+ * query, every word has to start a word of the title
+*/
+char* titleQuery(char** words, int count)
+{
+  size_t length = 1;
+  int i;
+
+  for (i = 0; i < count; i++)
+    length += strlen(words[i]) + 4;
+
+  char* query = malloc(length);
+  if (query == NULL)
+    return NULL;
+
+  // The words contain no quotes, splitTitle drops them
+  query[0] = 0;
+  for (i = 0; i < count; i++)
+  {
+    strcat(query, i ? " \"" : "\"");
+    strcat(query, words[i]);
+    strcat(query, "\"*");
+  }
+
+  return query;
+}
+
+// A book found by sqliteSearchBooks, see compareFound
+typedef struct
+{
+  char* title;
+  char* url;
+  char* date;
+  int whole;    // Terms matching a whole word of the title
+} sqlitefound;
+
+/*
+ * This function ranks the books found like the memory storage does: books matching more
+ * terms as whole words first, then the ones which are due first
+*/
+int compareFound(const void* a, const void* b)
+{
+  const sqlitefound* x = a;
+  const sqlitefound* y = b;
+  int res;
+
+  if (x->whole != y->whole)
+    return y->whole - x->whole;
+  if ((res = strcmp(x->date, y->date)) || (res = strcmp(x->title, y->title)))
+    return res;
+
+  return strcmp(x->url ? x->url : "", y->url ? y->url : "");
+}
+
+/*
+ * This function splits title like the full-text index does and checks that every word
+ * starts a word of it. It returns 1 if they all do and counts the words which appear as
+ * whole word in whole, 0 if one doesn't and -1 on errors.
+*/
+int matchWords(const char* title, char** words, int count, int* whole)
+{
+  char* text = strdup(title);
+  char** titleWords = malloc((strlen(title) / 2 + 1) * sizeof(char*));
+  int matched = 1;
+  int i, j;
+
+  *whole = 0;
+  if ((text == NULL) || (titleWords == NULL))
+  {
+    free(titleWords);
+    free(text);
+
+    return -1;
+  }
+
+  int n = splitTitle(text, titleWords, strlen(title) / 2 + 1);
+  for (i = 0; (i < count) && matched; i++)
+  {
+    size_t length = strlen(words[i]);
+
+    for (j = 0; (j < n) && strcmp(titleWords[j], words[i]); j++);
+    if (j < n)
+    {
+      (*whole)++;
+      continue;
+    }
+
+    for (j = 0; (j < n) && strncmp(titleWords[j], words[i], length); j++);
+    matched = j < n;
+  }
+
+  free(titleWords);
+  free(text);
+
+  return matched;
+}
+
+/*
+ * This function calls book for up to limit books (all if limit is negative) whose titles
+ * have a word starting with each of the terms. Books matching more terms as whole words
+ * come first, then the ones which are due first. Titles and terms are split into words
+ * by splitTitle, like the memory storage does. Databases without the full-text index
+ * (see createTitleIndex) are scanned and every title is split the same way, LIKE can't
+ * fold the diacritics.
+*/
+int sqliteSearchBooks(void* connection, char* terms, int limit, void (*book)(char* title, char* url, char* date, void* data), void* data)
+{
+  sqliteconn* conn = connection;
+  sqlite3* database = conn->handle;
+  sqlite3_stmt* command;
+  char* words[MAX_TERMS];
+  sqlitefound* found = NULL;
+  int nfound = 0;
+  int size = 0;
+  char* query = NULL;
+  int count;
+  int ret;
+  int i;
+
+  if ((conn->titleIndex < 0) && runPragma(database, "SELECT COUNT(*) FROM sqlite_master WHERE name = 'books_fts';", &conn->titleIndex))
+    return -1;
+
+  char* text = strdup(terms);
+  if (text == NULL)
+  {
+    fprintf(stderr, "Failed to search books, reason: out of memory\n");
+
+    return -1;
+  }
+
+  count = splitTitle(text, words, MAX_TERMS);
+  if (count == 0)
+  {
+    free(text);
+
+    return 0;
+  }
+
+  if (conn->titleIndex)
+  {
+    query = titleQuery(words, count);
+    if (query == NULL)
+    {
+      fprintf(stderr, "Failed to search books, reason: out of memory\n");
+      free(text);
+
+      return -1;
+    }
+
+    ret = sqlite3_prepare_v2(database, "SELECT books.name, books.url, books.date FROM books_fts JOIN books ON books.rowid = books_fts.rowid "
+                                       "WHERE books_fts MATCH ?;", -1, &command, NULL);
+    if (!ret)
+      ret = sqlite3_bind_text(command, 1, query, -1, SQLITE_STATIC);
+  }
+  else
+    ret = sqlite3_prepare_v2(database, "SELECT name, url, date FROM books;", -1, &command, NULL);
+
+  // A failed prepare leaves command NULL, which finalize ignores
+  if (ret)
+  {
+    fprintf(stderr, "Failed to search books, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+    free(query);
+    free(text);
+
+    return -1;
+  }
+
+  // All matches are ranked before the first one is handed out
+  while ((ret = sqlite3_step(command)) == SQLITE_ROW)
+  {
+    char* title = (char*)sqlite3_column_text(command, 0);
+    char* url = (char*)sqlite3_column_text(command, 1);
+    char* date = (char*)sqlite3_column_text(command, 2);
+    int whole;
+
+    // The full-text index found the matching books already
+    int matched = matchWords(title, words, count, &whole);
+    if (matched < 0)
+    {
+      ret = SQLITE_NOMEM;
+      break;
+    }
+    if (!matched && !conn->titleIndex)
+      continue;
+
+    if (nfound == size)
+    {
+      sqlitefound* more = realloc(found, (size ? size * 2 : 16) * sizeof(sqlitefound));
+      if (more == NULL)
+      {
+        ret = SQLITE_NOMEM;
+        break;
+      }
+      found = more;
+      size = size ? size * 2 : 16;
+    }
+
+    sqlitefound* f = &found[nfound];
+
+    f->title = strdup(title);
+    f->url = url ? strdup(url) : NULL;
+    f->date = strdup(date);
+    if ((f->title == NULL) || (f->date == NULL) || ((url != NULL) && (f->url == NULL)))
+    {
+      free(f->title);
+      free(f->url);
+      free(f->date);
+      ret = SQLITE_NOMEM;
+      break;
+    }
+    f->whole = whole;
+    nfound++;
+  }
+
+  if (ret != SQLITE_DONE)
+    fprintf(stderr, "Failed to search books, reason: %s\n", ret == SQLITE_NOMEM ? "out of memory" : sqlite3_errmsg(database));
+  else
+  {
+    qsort(found, nfound, sizeof(sqlitefound), compareFound);
+    for (i = 0; (i < nfound) && ((limit < 0) || (i < limit)); i++)
+      book(found[i].title, found[i].url, found[i].date, data);
+  }
+
+  for (i = 0; i < nfound; i++)
+  {
+    free(found[i].title);
+    free(found[i].url);
+    free(found[i].date);
+  }
+  free(found);
+  sqlite3_finalize(command);
+  free(query);
+  free(text);
+
+  return ret == SQLITE_DONE ? 0 : -1;
+}
+
+/*
+ * This function checks if an update is needed (the last update was never or
+ * is older than the specified amount of minutes)
+*/
+int sqliteNeedUpdate(void* connection, int minutes)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create and execute the select-command
+  sqlite3_stmt* command;
+  int ret;
+  char sql[1024];
+  snprintf(sql, 1024, "SELECT * FROM config WHERE key='lastupdate' AND value > datetime('now', '-%i minutes');", minutes);
+  if (sqlite3_prepare_v2(database, sql, -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to get last update, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  ret = sqlite3_step(command);
+  if (ret == SQLITE_ROW) // If there is a result, we don't need to update
+    ret = 0;
+  else if (ret == SQLITE_DONE)
+    ret = 1;
+  else // The database is busy or broken, don't start an update now
+    ret = -1;
+
+  sqlite3_finalize(command);
+  
+  return ret;
+}
+
+/*
+ * Call this function after an update was done, it will update the lastupdate-value
+ * and the bytes transferred by the update
+*/
+int sqliteUpdateDone(void* connection, feedstats* stats)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  // Create and execute the insert-command
+  sqlite3_stmt* command;
+  if (sqlite3_prepare_v2(database, "INSERT OR REPLACE INTO config (key, value) VALUES('lastupdate', datetime('now')), "
+                         "('wirebytes', ?), ('feedbytes', ?);", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to update lastupdate, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  sqlite3_bind_int64(command, 1, (sqlite3_int64)stats->wireBytes);
+  sqlite3_bind_int64(command, 2, (sqlite3_int64)stats->feedBytes);
+  if (sqlite3_step(command) != SQLITE_DONE)
+  {
+    fprintf(stderr, "Failed to update lastupdate, reason: %s\n", sqlite3_errmsg(database));
+    sqlite3_finalize(command);
+
+    return -1;
+  }
+
+  sqlite3_finalize(command);
+  
+  return 0;
+}
+
+/*
+ * This function reads the bytes transferred by the last update, both are 0 before the
+ * first one
+*/
+int sqliteGetFeedStats(void* connection, feedstats* stats)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  sqlite3_stmt* command;
+  int ret;
+
+  stats->wireBytes = 0;
+  stats->feedBytes = 0;
+  if (sqlite3_prepare_v2(database, "SELECT key, value FROM config WHERE key IN ('wirebytes', 'feedbytes');", -1, &command, NULL))
+  {
+    fprintf(stderr, "Failed to get feed stats, reason: %s\n", sqlite3_errmsg(database));
+
+    return -1;
+  }
+
+  while ((ret = sqlite3_step(command)) == SQLITE_ROW)
+  {
+    size_t value = (size_t)sqlite3_column_int64(command, 1);
+    if (strcmp((const char*)sqlite3_column_text(command, 0), "wirebytes") == 0)
+      stats->wireBytes = value;
+    else
+      stats->feedBytes = value;
+  }
+
+  if (ret != SQLITE_DONE)
+    fprintf(stderr, "Failed to get feed stats, reason: %s\n", sqlite3_errmsg(database));
+  sqlite3_finalize(command);
+
+  return ret == SQLITE_DONE ? 0 : -1;
+}
+
+/*
+ * This function does the maintenance of the database and should be called when there is
+ * nothing else to do, it locks the whole database for a moment. Databases created without
+ * incremental vacuum are vacuumed once to enable it, afterwards the free pages left by
+ * replacing the books are only given back to the file system once they make up a share
+ * of MAINTAIN_FREE_SHARE. The query planner statistics are updated as well. If stats is
+ * given, it is filled with the size of the database afterwards.
+*/
+int sqliteMaintainDatabase(void* connection, dbstats* stats)
+{
+  sqlite3* database = ((sqliteconn*)connection)->handle;
+  int vacuum;
+  int pageSize;
+  int pages;
+  int freePages;
+
+  if (runPragma(database, "PRAGMA auto_vacuum;", &vacuum) || runPragma(database, "PRAGMA page_count;", &pages) ||
+      runPragma(database, "PRAGMA freelist_count;", &freePages))
+    return -1;
+
+  if (vacuum != 2)
+  {
+    // Vacuuming renumbers the books, so the title index has to be rebuilt afterwards
+    if (runPragma(database, "VACUUM;", NULL))
+    {
+      fprintf(stderr, "Failed to enable incremental vacuum, trying again next time\n");
+
+      return -1;
+    }
+
+    if (createTitleIndex(database, 1))
+      fprintf(stderr, "Full-text search is not available, titles are searched without index\n");
+  }
+  else if ((freePages > 0) && (freePages * MAINTAIN_FREE_SHARE >= pages) && runPragma(database, "PRAGMA incremental_vacuum;", NULL))
+    return -1;
+
+  if (runPragma(database, "PRAGMA optimize;", NULL))
+    return -1;
+
+  if (stats == NULL)
+    return 0;
+
+  if (runPragma(database, "PRAGMA page_size;", &pageSize) || runPragma(database, "PRAGMA page_count;", &pages) ||
+      runPragma(database, "PRAGMA freelist_count;", &freePages))
+    return -1;
+
+  stats->size = (long)pageSize * pages;
+  stats->pages = pages;
+  stats->freePages = freePages;
+
+  return 0;
+}
+
+storage sqliteStorage =
+{
+  "sqlite",
+  1,
+  sqliteOpenDatabase,
+  sqliteOpenDatabaseReadOnly,
+  sqliteCloseDatabase,
+  sqliteSetBusyTimeout,
+  sqliteDataChanged,
+  sqliteBeginTransaction,
+  sqliteClearBooklist,
+  sqliteAddBook,
+  sqliteEndTransaction,
+  sqliteAbortTransaction,
+  sqliteGetOk,
+  sqliteGetSoon,
+  sqliteGetCritical,
+  sqliteGetLate,
+  sqliteLoadDueDays,
+  sqliteCountBooks,
+  sqliteListBooks,
+  sqliteSearchBooks,
+  sqliteNeedUpdate,
+  sqliteUpdateDone,
+  sqliteGetFeedStats,
+  sqliteMaintainDatabase
+};
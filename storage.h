@@ -0,0 +1,69 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STORAGE_H
+#define _STORAGE_H
+
+#include "database.h"
+
+/*
+ * Operations of a storage backend, database.c routes every call of database.h
+ * to the backend of the context. See database.h for their meaning. The open
+ * functions return the state of the connection, which is handed to all others.
+*/
+typedef struct
+{
+  char* name;
+  int persistent;   // Whether other processes can see the data
+  void* (*openDatabase)(char* db);
+  void* (*openDatabaseReadOnly)(char* db);
+  void (*closeDatabase)(void* connection);
+  int (*setBusyTimeout)(void* connection, int ms);
+  int (*dataChanged)(void* connection);
+  int (*beginTransaction)(void* connection);
+  int (*clearBooklist)(void* connection);
+  int (*addBook)(void* connection, char* title, char* url, char* date);
+  int (*endTransaction)(void* connection);
+  int (*abortTransaction)(void* connection);
+  int (*getOk)(void* connection);
+  int (*getSoon)(void* connection);
+  int (*getCritical)(void* connection);
+  int (*getLate)(void* connection);
+  int (*loadDueDays)(void* connection, duedays* dd);
+  int (*countBooks)(void* connection, int32_t before);   // Books due before the day, all for INT32_MAX
+  int (*listBooks)(void* connection, int limit, void (*book)(char* title, char* url, char* date, void* data), void* data);
+  int (*searchBooks)(void* connection, char* terms, int limit, void (*book)(char* title, char* url, char* date, void* data), void* data);
+  int (*needUpdate)(void* connection, int minutes);
+  int (*updateDone)(void* connection, feedstats* stats);   // Records the bytes of the update as well
+  int (*getFeedStats)(void* connection, feedstats* stats);   // Bytes of the last update, 0 before the first
+  int (*maintainDatabase)(void* connection, dbstats* stats);
+} storage;
+
+struct dbcontext
+{
+  storage* backend;
+  void* connection;   // State of the backend
+  char db[1024];
+  int updateLock;     // See acquireUpdateLock
+};
+
+extern storage sqliteStorage;
+extern storage memoryStorage;
+
+#endif // _STORAGE_H
@@ -0,0 +1,330 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stress.h"
+#include "database.h"
+#include "duedays.h"
+#include "fetcher.h"
+#include "writer.h"
+#include <glib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STRESS_SMALL 50     // Books of the even rounds
+#define STRESS_LARGE 100    // Books of the odd rounds
+#define STRESS_TIMEOUT 300  // Seconds
+
+/*
+ * Every thread of the stress test owns a database with its own writer, a reader thread
+ * checks that it only ever sees complete snapshots while the writer commits
+*/
+typedef struct
+{
+  char db[1024];
+  writer* output;
+  fetcher* feed;
+  pthread_t producer;
+  pthread_t reader;
+} stressdb;
+
+char* stressStorage = "sqlite";
+char* stressUrl = NULL;
+int stressRounds = 50;
+atomic_int reading = 1;
+atomic_int stressReads = 0;
+atomic_int stressErrors = 0;
+int stressCommits = 0;
+int stressFailed = 0;
+
+/*
+ * This function is called in the main context for every finished update
+*/
+gboolean stressCommitted(gpointer result)
+{
+  stressCommits++;
+  if (!GPOINTER_TO_INT(result))
+    stressFailed++;
+
+  return FALSE;
+}
+
+/*
+ * This function queues the snapshots of a database and optionally fetches the feed
+ * into it afterwards, in parallel to the other threads
+*/
+void* produce(void* data)
+{
+  stressdb* s = data;
+  char title[64];
+  char date[16];
+  int round, i;
+
+  for (round = 0; round < stressRounds; round++)
+  {
+    int books = round % 2 ? STRESS_LARGE : STRESS_SMALL;
+
+    writeBegin(s->output);
+    for (i = 0; i < books; i++)
+    {
+      snprintf(title, 64, "Book %i of round %i", i, round);
+      snprintf(date, 16, "2030-%02i-%02i", i % 12 + 1, i % 28 + 1);
+      writeBook(s->output, title, NULL, date);
+    }
+    writeEnd(s->output, 1, NULL);
+  }
+
+  if (stressUrl == NULL)
+    return NULL;
+
+  // The feed is fetched once the readers are done with the snapshots
+  while (atomic_load(&reading))
+    usleep(1000);
+  fetchList(s->feed, stressUrl);
+
+  return NULL;
+}
+
+/*
+ * This function reads the books of a database through its own context until all
+ * snapshots were committed, every read has to see one snapshot completely
+*/
+void* readBooks(void* data)
+{
+  stressdb* s = data;
+  duedays dd;
+
+  dbcontext* ctx = openDatabase(stressStorage, s->db);
+  if (ctx == NULL)
+  {
+    atomic_fetch_add(&stressErrors, 1);
+
+    return NULL;
+  }
+  setBusyTimeout(ctx, 5000);
+  initDueDays(&dd);
+
+  while (atomic_load(&reading))
+  {
+    if (dataChanged(ctx) < 0)
+      atomic_fetch_add(&stressErrors, 1);
+
+    if (loadDueDays(ctx, &dd))
+      atomic_fetch_add(&stressErrors, 1);
+    else if ((dd.count != 0) && (dd.count != STRESS_SMALL) && (dd.count != STRESS_LARGE))
+    {
+      fprintf(stderr, "Stress: read %i books from %s, a snapshot is incomplete\n", dd.count, s->db);
+      atomic_fetch_add(&stressErrors, 1);
+    }
+
+    atomic_fetch_add(&stressReads, 1);
+  }
+
+  freeDueDays(&dd);
+  closeDatabase(ctx);
+
+  return NULL;
+}
+
+/*
+ * This function checks that two contexts of the same database exclude each other from
+ * updating it. It returns 0 on success or -1 on errors.
+*/
+int checkLocks(char* db)
+{
+  int res = 0;
+
+  dbcontext* first = openDatabase(stressStorage, db);
+  dbcontext* second = openDatabase(stressStorage, db);
+  if ((first == NULL) || (second == NULL))
+    res = -1;
+  else if (!strcmp(stressStorage, "sqlite") && ((acquireUpdateLock(first) != 1) || (acquireUpdateLock(second) != 0)))
+  {
+    fprintf(stderr, "Stress: the update lock of %s is not exclusive\n", db);
+    res = -1;
+  }
+
+  if (first != NULL)
+    closeDatabase(first);
+  if (second != NULL)
+    closeDatabase(second);
+
+  return res;
+}
+
+/*
+ * This function counts the books of a database, it returns -1 on errors
+*/
+int countBooks(char* db)
+{
+  duedays dd;
+  int count = -1;
+
+  dbcontext* ctx = openDatabase(stressStorage, db);
+  if (ctx == NULL)
+    return -1;
+  setBusyTimeout(ctx, 5000);
+
+  initDueDays(&dd);
+  if (!loadDueDays(ctx, &dd))
+    count = dd.count;
+  freeDueDays(&dd);
+  closeDatabase(ctx);
+
+  return count;
+}
+
+void printStressUsage()
+{
+  printf("Usage: wmslub --stress [-t <Threads>] [-r <Rounds>] [-m] [-u <RSS-URL>]\n");
+}
+
+/*
+ * This function runs the stress test from the command line: every thread replaces the
+ * books of its own database through its own writer while a reader thread checks each
+ * snapshot, with -u the feed is fetched into all databases at once afterwards. The
+ * databases are created next to each other in the temporary directory and removed
+ * again. It returns 0 if no error and no incomplete snapshot was seen.
+*/
+int runStress(int argc, char* argv[])
+{
+  int threads = 4;
+  int expected;
+  int errors = 0;
+  int i;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:r:mu:")) != -1)
+  {
+    switch (opt)
+    {
+    case 't':
+      threads = atoi(optarg);
+      break;
+    case 'r':
+      stressRounds = atoi(optarg);
+      break;
+    case 'm':
+      stressStorage = "memory";
+      break;
+    case 'u':
+      stressUrl = optarg;
+      break;
+    default:
+      printStressUsage();
+      return 1;
+    }
+  }
+
+  if ((threads < 1) || (stressRounds < 1))
+  {
+    printStressUsage();
+    return 1;
+  }
+
+  stressdb* dbs = calloc(threads, sizeof(stressdb));
+  if (dbs == NULL)
+  {
+    fprintf(stderr, "Failed to allocate memory for the stress test\n");
+
+    return 1;
+  }
+
+  // Every database gets its own writer and fetcher
+  for (i = 0; i < threads; i++)
+  {
+    snprintf(dbs[i].db, 1024, "%s/wmslub-stress-%i-%i.db", g_get_tmp_dir(), (int)getpid(), i);
+    if (checkLocks(dbs[i].db))
+      errors++;
+
+    dbs[i].output = startWriter(stressStorage, dbs[i].db, stressCommitted);
+    dbs[i].feed = dbs[i].output ? newFetcher(dbs[i].output) : NULL;
+    if (dbs[i].feed == NULL)
+    {
+      fprintf(stderr, "Stress: failed to set up %s\n", dbs[i].db);
+
+      return 1;
+    }
+  }
+
+  for (i = 0; i < threads; i++)
+  {
+    pthread_create(&dbs[i].reader, NULL, readBooks, &dbs[i]);
+    pthread_create(&dbs[i].producer, NULL, produce, &dbs[i]);
+  }
+
+  // The writers notify through the main context
+  expected = threads * (stressRounds + (stressUrl ? 1 : 0));
+  time_t timeout = time(NULL) + STRESS_TIMEOUT;
+  while ((stressCommits < expected) && (time(NULL) < timeout))
+  {
+    if (!g_main_context_iteration(NULL, FALSE))
+      usleep(1000);
+
+    if (stressCommits >= threads * stressRounds)
+      atomic_store(&reading, 0);
+  }
+  atomic_store(&reading, 0);
+
+  if (stressCommits < expected)
+  {
+    fprintf(stderr, "Stress: only %i of %i updates finished in time\n", stressCommits, expected);
+    errors++;
+  }
+
+  for (i = 0; i < threads; i++)
+  {
+    pthread_join(dbs[i].producer, NULL);
+    pthread_join(dbs[i].reader, NULL);
+  }
+
+  // Every database has to end up with the last snapshot, or the feed if it was fetched. The
+  // books are counted before the writer goes, memory databases are gone with it.
+  int last = (stressRounds - 1) % 2 ? STRESS_LARGE : STRESS_SMALL;
+  int first = -1;
+  for (i = 0; i < threads; i++)
+  {
+    int count = countBooks(dbs[i].db);
+    stopWriter(dbs[i].output);
+    freeFetcher(dbs[i].feed);
+
+    if (first < 0)
+      first = count;
+    if ((count < 0) || (stressUrl ? (count != first) : (count != last)))
+    {
+      fprintf(stderr, "Stress: %s holds %i books\n", dbs[i].db, count);
+      errors++;
+    }
+
+    unlink(dbs[i].db);
+    strcat(dbs[i].db, ".lock");
+    unlink(dbs[i].db);
+  }
+  free(dbs);
+
+  errors += atomic_load(&stressErrors) + stressFailed;
+  printf("Stress %s: %i threads, %i updates, %i reads, %i errors\n", errors ? "failed" : "passed", threads,
+         stressCommits, atomic_load(&stressReads), errors);
+
+  return errors ? 1 : 0;
+}
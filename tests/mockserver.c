@@ -0,0 +1,401 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mockserver.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define TRICKLE_PIECES 20
+
+struct mockserver
+{
+  int listener;
+  int port;
+  pthread_t thread;
+  atomic_int requests;
+  atomic_int connections;   // Connections still being answered
+};
+
+typedef struct
+{
+  mockserver* server;
+  int socket;
+} mockconn;
+
+char* months[] = { "Jan", "Feb", "Mär", "Apr", "Mai", "Jun", "Jul", "Aug", "Sep", "Okt", "Nov", "Dez" };
+
+/*
+ * This function sleeps for the given milliseconds
+*/
+void mockSleep(int ms)
+{
+  struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+  nanosleep(&ts, NULL);
+}
+
+/*
+ * This function returns the value of a query parameter or def if it isn't given
+*/
+int mockParam(char* query, char* name, int def)
+{
+  size_t length = strlen(name);
+  char* pos = query;
+
+  while ((pos != NULL) && *pos)
+  {
+    if (!strncmp(pos, name, length) && (pos[length] == '='))
+      return atoi(pos + length + 1);
+
+    pos = strchr(pos, '&');
+    if (pos != NULL)
+      pos++;
+  }
+
+  return def;
+}
+
+/*
+ * This function sends all of data, it returns 0 on success or -1 if the client is gone
+*/
+int mockSend(int socket, const char* data, size_t length)
+{
+  while (length > 0)
+  {
+    ssize_t sent = send(socket, data, length, MSG_NOSIGNAL);
+    if (sent <= 0)
+      return -1;
+
+    data += sent;
+    length -= sent;
+  }
+
+  return 0;
+}
+
+/*
+ * This function builds the feed of a page, it has to be freed by the caller
+*/
+char* mockFeed(mockserver* server, char* query, size_t* length)
+{
+  int items = mockParam(query, "items", 50);
+  int page = mockParam(query, "page", 1);
+  int pages = mockParam(query, "pages", 1);
+  int link = mockParam(query, "link", 0);
+  time_t now = time(NULL);
+  char next[256] = "";
+  int i;
+
+  if ((page > pages) && mockParam(query, "clamp", 0))
+    page = pages;
+  if (page > pages)
+    items = 0;
+
+  // The next page keeps all parameters, only the page changes
+  int relative = mockParam(query, "relative", 0);
+  int loop = mockParam(query, "loop", 0);
+  char host[64] = "";
+  if (!relative)
+    snprintf(host, 64, "http://127.0.0.1:%i", server->port);
+  if (link && (page < pages))
+    snprintf(next, 256, "<atom:link xmlns:atom=\"http://www.w3.org/2005/Atom\" rel=\"next\" "
+             "href=\"%s/feed?link=1&amp;relative=%i&amp;loop=%i&amp;pages=%i&amp;items=%i&amp;page=%i\"/>",
+             host, relative, loop, pages, mockParam(query, "items", 50), loop ? page : page + 1);
+
+  size_t size = 256 + strlen(next) + items * 256;
+  char* feed = malloc(size);
+  if (feed == NULL)
+    return NULL;
+
+  char* pos = feed;
+  pos += sprintf(pos, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<rss version=\"2.0\"><channel><title>Konto</title>%s", next);
+  for (i = 0; i < items; i++)
+  {
+    // One book is due on every day from today on
+    time_t due = now + (time_t)i * 86400;
+    struct tm tm;
+    gmtime_r(&due, &tm);
+
+    pos += sprintf(pos, "<item><title>Buch %i von Seite %i</title><link>http://127.0.0.1/book/%i/%i</link>"
+                   "<description>Ausgeliehen, R\xc3\xbc" "ckgabe bis %i %s %i</description></item>\n",
+                   i, page, page, i, tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900);
+  }
+  pos += sprintf(pos, "</channel></rss>\n");
+  *length = pos - feed;
+
+  return feed;
+}
+
+/*
+ * This function compresses the feed with gzip in place of the plain one, it returns
+ * 0 on success
+*/
+int mockCompress(char** feed, size_t* length)
+{
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return -1;
+
+  size_t size = deflateBound(&stream, *length);
+  char* packed = malloc(size);
+  if (packed == NULL)
+  {
+    deflateEnd(&stream);
+    return -1;
+  }
+
+  stream.next_in = (Bytef*)*feed;
+  stream.avail_in = *length;
+  stream.next_out = (Bytef*)packed;
+  stream.avail_out = size;
+  if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+  {
+    deflateEnd(&stream);
+    free(packed);
+    return -1;
+  }
+
+  free(*feed);
+  *feed = packed;
+  *length = stream.total_out;
+  deflateEnd(&stream);
+
+  return 0;
+}
+
+/*
+ * This function answers a single request, the connection is closed afterwards
+*/
+void* mockAnswer(void* data)
+{
+  mockconn* conn = data;
+  mockserver* server = conn->server;
+  char request[4096];
+  char header[512];
+  size_t received = 0;
+  ssize_t n;
+
+  // Read the request up to the end of its header
+  while ((received < sizeof(request) - 1) && ((n = recv(conn->socket, request + received, sizeof(request) - 1 - received, 0)) > 0))
+  {
+    received += n;
+    request[received] = 0;
+    if (strstr(request, "\r\n\r\n") != NULL)
+      break;
+  }
+  request[received] = 0;
+  atomic_fetch_add(&server->requests, 1);
+
+  char* path = strchr(request, ' ');
+  char* query = path ? strchr(path, '?') : NULL;
+  char* end = path ? strchr(path + 1, ' ') : NULL;
+  if (end != NULL)
+    *end = 0;
+  if (query != NULL)
+    query++;
+
+  int delay = mockParam(query, "delay", 0);
+  int status = mockParam(query, "status", 200);
+  int redirect = mockParam(query, "redirect", 0);
+  int trickle = mockParam(query, "trickle", 0);
+  int truncate = mockParam(query, "truncate", -1);
+  int drop = mockParam(query, "drop", -1);
+  int gzip = mockParam(query, "gzip", 0) && (end != NULL) && (strstr(end + 1, "gzip") != NULL);
+
+  if (delay > 0)
+    mockSleep(delay);
+
+  if (redirect > 0)
+  {
+    // The same request with one redirect less
+    char* count = strstr(query, "redirect=");
+    int length = snprintf(header, 512, "HTTP/1.1 302 Found\r\nLocation: /feed?%.*sredirect=%i%s\r\n"
+                          "Content-Length: 0\r\nConnection: close\r\n\r\n", (int)(count - query), query,
+                          redirect - 1, count + strcspn(count, "&"));
+    mockSend(conn->socket, header, length);
+  }
+  else if (status != 200)
+  {
+    int length = snprintf(header, 512, "HTTP/1.1 %i Mock\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+    if (status == 304)
+      length = snprintf(header, 512, "HTTP/1.1 304 Not Modified\r\nConnection: close\r\n\r\n");
+    mockSend(conn->socket, header, length);
+  }
+  else
+  {
+    size_t length = 0;
+    char* feed = mockFeed(server, query, &length);
+    if (gzip && (feed != NULL) && mockCompress(&feed, &length))
+      gzip = 0;
+    size_t sent = length;
+
+    if ((truncate >= 0) && ((size_t)truncate < length))
+      length = sent = truncate;
+    if ((drop >= 0) && ((size_t)drop < length))
+      sent = drop;
+
+    int headerLength = snprintf(header, 512, "HTTP/1.1 200 OK\r\nContent-Type: application/rss+xml; charset=utf-8\r\n"
+                                "%sContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                                gzip ? "Content-Encoding: gzip\r\n" : "", length);
+    if ((feed != NULL) && !mockSend(conn->socket, header, headerLength))
+    {
+      if (trickle > 0)
+      {
+        size_t piece = sent / TRICKLE_PIECES + 1;
+        size_t pos;
+
+        for (pos = 0; pos < sent; pos += piece)
+        {
+          if (mockSend(conn->socket, feed + pos, pos + piece < sent ? piece : sent - pos))
+            break;
+          mockSleep(trickle);
+        }
+      }
+      else
+        mockSend(conn->socket, feed, sent);
+    }
+    free(feed);
+  }
+
+  close(conn->socket);
+  free(conn);
+  atomic_fetch_sub(&server->connections, 1);
+
+  return NULL;
+}
+
+/*
+ * This function accepts connections until the server is stopped, every one is answered
+ * by its own thread
+*/
+void* mockAccept(void* data)
+{
+  mockserver* server = data;
+  pthread_t thread;
+  int socket;
+
+  while ((socket = accept(server->listener, NULL, NULL)) >= 0)
+  {
+    mockconn* conn = malloc(sizeof(mockconn));
+    if (conn == NULL)
+    {
+      close(socket);
+      continue;
+    }
+
+    conn->server = server;
+    conn->socket = socket;
+    atomic_fetch_add(&server->connections, 1);
+    if (pthread_create(&thread, NULL, mockAnswer, conn))
+    {
+      atomic_fetch_sub(&server->connections, 1);
+      close(socket);
+      free(conn);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+
+  return NULL;
+}
+
+/*
+ * This function starts the server on a free port of 127.0.0.1, it returns NULL on errors
+*/
+mockserver* startMockServer()
+{
+  struct sockaddr_in address;
+  socklen_t length = sizeof(address);
+  int one = 1;
+
+  mockserver* server = calloc(1, sizeof(mockserver));
+  if (server == NULL)
+    return NULL;
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0;
+
+  server->listener = socket(AF_INET, SOCK_STREAM, 0);
+  if ((server->listener < 0) ||
+      setsockopt(server->listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+      bind(server->listener, (struct sockaddr*)&address, sizeof(address)) ||
+      listen(server->listener, 64) ||
+      getsockname(server->listener, (struct sockaddr*)&address, &length))
+  {
+    fprintf(stderr, "Failed to start the mock server\n");
+    if (server->listener >= 0)
+      close(server->listener);
+    free(server);
+
+    return NULL;
+  }
+
+  server->port = ntohs(address.sin_port);
+  atomic_init(&server->requests, 0);
+  atomic_init(&server->connections, 0);
+
+  if (pthread_create(&server->thread, NULL, mockAccept, server))
+  {
+    close(server->listener);
+    free(server);
+
+    return NULL;
+  }
+
+  return server;
+}
+
+int mockPort(mockserver* server)
+{
+  return server->port;
+}
+
+/*
+ * This function returns the amount of requests answered so far
+*/
+int mockRequests(mockserver* server)
+{
+  return atomic_load(&server->requests);
+}
+
+/*
+ * This function stops the server after the running answers are done
+*/
+void stopMockServer(mockserver* server)
+{
+  shutdown(server->listener, SHUT_RDWR);
+  close(server->listener);
+  pthread_join(server->thread, NULL);
+
+  while (atomic_load(&server->connections) > 0)
+    mockSleep(10);
+
+  free(server);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MOCKSERVER_H
+#define _MOCKSERVER_H
+
+/*
+ * A local stand-in for the library, it serves feeds in the format of the SLUB on
+ * http://127.0.0.1:<port>/feed. The query parameters of a request select what it does:
+ *   items=N      items in the feed (50), their due dates start today
+ *   page=N       page of a paged feed, pages beyond pages=N (1) have no items
+ *   clamp=1      serve the last page for the pages beyond instead
+ *   link=1       link the pages with rel="next" instead of a page parameter
+ *   relative=1   link them relative to the page
+ *   loop=1       link every page to itself
+ *   delay=MS     wait before answering
+ *   trickle=MS   send the body in 20 pieces, waiting MS between them
+ *   status=N     answer with this status (e.g. 304, 500, 503) and without a feed
+ *   redirect=N   redirect N times before serving the feed
+ *   truncate=N   serve only the first N bytes of the feed as complete answer
+ *   drop=N       close the connection after N bytes of the announced feed
+ *   gzip=1       compress the feed if the request accepts gzip
+*/
+typedef struct mockserver mockserver;
+
+mockserver* startMockServer();
+int mockPort(mockserver* server);
+int mockRequests(mockserver* server);
+void stopMockServer(mockserver* server);
+
+#endif // _MOCKSERVER_H
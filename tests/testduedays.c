@@ -0,0 +1,171 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "duedays.h"
+#include <stdio.h>
+#include <string.h>
+
+int checks = 0;
+int failures = 0;
+
+/*
+ * This function records the result of a check and reports it if it failed
+*/
+void check(int ok, char* what)
+{
+  checks++;
+  if (!ok)
+  {
+    failures++;
+    fprintf(stderr, "FAILED: %s\n", what);
+  }
+}
+
+/*
+ * This function counts the buckets the slow way, one day after the other
+*/
+void countSlowly(int32_t* days, int count, int32_t day, int* thresholds, int nthresholds, int* counts)
+{
+  int i, j;
+
+  memset(counts, 0, (nthresholds + 2) * sizeof(int));
+  for (i = 0; i < count; i++)
+  {
+    if (days[i] < day)
+    {
+      counts[0]++;
+      continue;
+    }
+
+    for (j = 0; (j < nthresholds) && (days[i] > day + thresholds[j]); j++);
+    counts[j + 1]++;
+  }
+}
+
+/*
+ * This function checks the parsing of the thresholds given with -b
+*/
+void testParse()
+{
+  int thresholds[MAX_THRESHOLDS];
+
+  check(parseThresholds("5", thresholds) == 1, "one threshold is parsed");
+  check(thresholds[0] == 5, "one threshold keeps its value");
+
+  check(parseThresholds("0,1,2,3,5,8,13,21", thresholds) == MAX_THRESHOLDS, "the maximum of thresholds is parsed");
+  check((thresholds[0] == 0) && (thresholds[4] == 5) && (thresholds[7] == 21), "the maximum of thresholds keeps the values");
+
+  check(parseThresholds("0,1,2,3,5,8,13,21,34", thresholds) == -1, "more thresholds than the maximum are rejected");
+  check(parseThresholds("", thresholds) == -1, "an empty list is rejected");
+  check(parseThresholds("5,2", thresholds) == -1, "descending thresholds are rejected");
+  check(parseThresholds("2,2", thresholds) == -1, "repeated thresholds are rejected");
+  check(parseThresholds("1,,2", thresholds) == -1, "empty thresholds are rejected");
+  check(parseThresholds("-1", thresholds) == -1, "negative thresholds are rejected");
+  check(parseThresholds("3651", thresholds) == -1, "thresholds beyond ten years are rejected");
+  check(parseThresholds("1,x", thresholds) == -1, "garbage is rejected");
+  check(parseThresholds("1,", thresholds) == 1, "a trailing comma is accepted");
+}
+
+/*
+ * This function checks countBuckets against counting day by day, for the given thresholds
+*/
+void testCount(char* spec, char* what)
+{
+  int thresholds[MAX_THRESHOLDS];
+  int counts[MAX_THRESHOLDS + 2];
+  int expected[MAX_THRESHOLDS + 2];
+  int32_t days[200];
+  int32_t day = daysFromCivil(2026, 10, 19);
+  int nthresholds = parseThresholds(spec, thresholds);
+  duedays dd;
+  int i, total = 0;
+
+  // Every day from 30 days ago to 70 days ahead, twice and not in order
+  initDueDays(&dd);
+  for (i = 0; i < 200; i++)
+  {
+    days[i] = day - 30 + (i * 37) % 100;
+    addDueDay(&dd, days[i]);
+  }
+  sortDueDays(&dd);
+
+  countBuckets(&dd, day, thresholds, nthresholds, counts);
+  countSlowly(days, 200, day, thresholds, nthresholds, expected);
+
+  check(!memcmp(counts, expected, (nthresholds + 2) * sizeof(int)), what);
+  for (i = 0; i < nthresholds + 2; i++)
+    total += counts[i];
+  check(total == 200, "every book is in exactly one bucket");
+
+  freeDueDays(&dd);
+}
+
+/*
+ * This function checks the buckets of an empty list and of books on the boundaries
+*/
+void testBoundaries()
+{
+  int thresholds[MAX_THRESHOLDS] = { 5 };
+  int counts[MAX_THRESHOLDS + 2];
+  int32_t day = daysFromCivil(2026, 10, 19);
+  duedays dd;
+
+  initDueDays(&dd);
+  countBuckets(&dd, day, thresholds, 1, counts);
+  check((counts[0] == 0) && (counts[1] == 0) && (counts[2] == 0), "an empty list has empty buckets");
+
+  // Yesterday is late, today and the fifth day are within the threshold, the sixth is not
+  addDueDay(&dd, day - 1);
+  addDueDay(&dd, day);
+  addDueDay(&dd, day + 5);
+  addDueDay(&dd, day + 6);
+  sortDueDays(&dd);
+  countBuckets(&dd, day, thresholds, 1, counts);
+  check((counts[0] == 1) && (counts[1] == 2) && (counts[2] == 1), "the boundaries belong to the right buckets");
+
+  freeDueDays(&dd);
+}
+
+/*
+ * This function checks the conversion between dates and day numbers
+*/
+void testDates()
+{
+  int y, m, d;
+
+  check(daysFromCivil(1970, 1, 1) == 0, "the epoch is day 0");
+  check(daysFromCivil(2000, 3, 1) == 11017, "leap years are counted");
+
+  civilFromDays(daysFromCivil(2024, 2, 29), &y, &m, &d);
+  check((y == 2024) && (m == 2) && (d == 29), "dates survive the conversion");
+}
+
+int main()
+{
+  testParse();
+  testCount("5", "one threshold is counted like day by day");
+  testCount("0,5", "the default thresholds are counted like day by day");
+  testCount("0,1,2,3,5,8,13,21", "the maximum of thresholds is counted like day by day");
+  testBoundaries();
+  testDates();
+
+  printf("testduedays: %i checks, %i failed\n", checks, failures);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "booklist.h"
+#include "mockserver.h"
+#include "rssscan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Runs updateList against the mock server (see mockserver.h) and checks how every
+ * scenario ends and how long it takes. The time limits are far above what the updates
+ * need on an idle machine, they catch updates that wait for the wrong things, e.g. pages
+ * fetched one after another or stalls that are not given up within the time budget.
+*/
+
+typedef struct
+{
+  char* name;
+  char* query;      // Parameters for the mock server
+  char* paging;     // Page parameter, see setPaging
+  int window;
+  int budget;       // Seconds, 0 for the default
+  int commit;       // Whether the update has to be committed
+  int books;
+  double minMs;
+  double maxMs;
+} scenario;
+
+scenario scenarios[] =
+{
+  { "plain feed",             "items=50",                         NULL,   1, 0, 1,   50,    0, 1000 },
+  { "latency",                "items=50&delay=300",               NULL,   1, 0, 1,   50,  300, 1300 },
+  { "trickled body",          "items=200&trickle=50",             NULL,   1, 0, 1,  200,  900, 2500 },
+  { "not modified",           "status=304",                       NULL,   1, 0, 0,    0,    0, 1000 },
+  { "server error",           "status=500",                       NULL,   1, 0, 0,    0,    0, 1000 },
+  { "unavailable",            "status=503&delay=200",             NULL,   1, 0, 0,    0,  200, 1200 },
+  { "truncated xml",          "items=50&truncate=3000",           NULL,   1, 0, 0,    0,    0, 1000 },
+  { "dropped connection",     "items=50&drop=3000",               NULL,   1, 0, 0,    0,    0, 1000 },
+  { "redirects",              "items=50&redirect=3",              NULL,   1, 0, 1,   50,    0, 1000 },
+  { "stall beyond budget",    "items=50&trickle=200",             NULL,   1, 1, 0,    0,  900, 2000 },
+  { "linked pages",           "items=100&pages=3&link=1",         NULL,   1, 0, 1,  300,    0, 1500 },
+  { "relative links",         "items=100&pages=3&link=1&relative=1", NULL, 1, 0, 1,  300,    0, 1500 },
+  { "link to itself",         "link=1&relative=0&loop=1&pages=3&items=100&page=1", NULL, 1, 0, 1, 100, 0, 1500 },
+  { "pipelined pages",        "items=100&pages=4&delay=300",      "page", 4, 0, 1,  400,  600, 1300 },
+  { "last page repeated",     "items=100&pages=3&clamp=1",        "page", 4, 0, 1,  300,    0, 1000 },
+  { "page ignored",           "items=100&clamp=1",                "page", 4, 0, 1,  100,    0, 1000 },
+  { "large feed",             "items=5000",                       NULL,   1, 0, 1, 5000,    0, 3000 },
+  { "compressed feed",        "items=500&gzip=1",                 NULL,   1, 0, 1,  500,    0, 1000 },
+};
+
+/*
+ * Feeds the fast scanner has to leave to libxml2 (scanned 0), because libxml2 would reject
+ * them or they need more than the scanner knows. The markup in around is put into the
+ * channel around the item, before and after it.
+*/
+typedef struct
+{
+  char* name;
+  char* declaration;
+  char* title;
+  char* around[2];
+  int scanned;
+} scancase;
+
+scancase scancases[] =
+{
+  { "plain utf-8",            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>",     "Das Schlo&#223;",       { "", "" }, 1 },
+  { "no declaration",         "",                                               "Das Schloss",           { "", "" }, 1 },
+  { "blanks around equals",   "<?xml version=\"1.0\" encoding = 'utf-8'?>",      "Das Schloss",           { "", "" }, 1 },
+  { "latin-1",                "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>", "Das Schloss",           { "", "" }, 0 },
+  { "latin-1 with blanks",    "<?xml version=\"1.0\" encoding = \"latin1\"?>",   "Das Schloss",           { "", "" }, 0 },
+  { "unquoted encoding",      "<?xml version=\"1.0\" encoding=utf-8?>",          "Das Schloss",           { "", "" }, 0 },
+  { "utf-8 prefix",           "<?xml version=\"1.0\" encoding=\"utf-8x\"?>",     "Das Schloss",           { "", "" }, 0 },
+  { "encoding cut off",       "<?xml version=\"1.0\" encoding=\"utf?>",          "Das Schloss",           { "", "" }, 0 },
+  { "tab reference",          "",                                               "Das&#9;Schloss",        { "", "" }, 1 },
+  { "astral reference",       "",                                               "Das Schloss &#x1F4DA;", { "", "" }, 1 },
+  { "surrogate reference",    "",                                               "Das Schloss &#xD800;",  { "", "" }, 0 },
+  { "control reference",      "",                                               "Das Schloss &#1;",      { "", "" }, 0 },
+  { "noncharacter reference", "",                                               "Das Schloss &#xFFFE;",  { "", "" }, 0 },
+  { "beyond unicode",         "",                                               "Das &#x110000;",        { "", "" }, 0 },
+  { "raw control character",  "",                                               "Das\001Schloss",        { "", "" }, 0 },
+  { "utf-8 umlaut",           "",                                               "Sch\xc3\xb6nes Haus",   { "", "" }, 1 },
+  { "latin-1 umlaut",         "",                                               "Sch\xf6nes Haus",       { "", "" }, 0 },
+  { "overlong utf-8",         "",                                               "Das \xc0\xafSchloss",   { "", "" }, 0 },
+  { "raw surrogate",          "",                                               "Das \xed\xa0\x80",      { "", "" }, 0 },
+  { "raw noncharacter",       "",                                               "Das \xef\xbf\xbe",      { "", "" }, 0 },
+  { "truncated utf-8",        "",                                               "Das Schl\xc3",          { "", "" }, 0 },
+  { "latin-1 channel title",  "",                                               "Das Schloss",
+    { "<title>K\xf6nto</title>", "" }, 0 },
+  { "next link before items", "",                                               "Das Schloss",
+    { "<atom:link rel=\"next\" href=\"http://example.org/2\"/>", "" }, 0 },
+  { "next link after items",  "",                                               "Das Schloss",
+    { "", "<atom:link rel=\"next\" href=\"http://example.org/2\"/>" }, 0 },
+  { "next link in quotes",    "",                                               "Das Schloss",
+    { "<atom:link rel='next' href='http://example.org/2'/>", "" }, 0 },
+  { "next link with blanks",  "",                                               "Das Schloss",
+    { "", "<atom:link href=\"http://example.org/2\" rel = \"next\"/>" }, 0 },
+  { "self link",              "",                                               "Das Schloss",
+    { "<atom:link rel=\"self\" href=\"http://example.org/1\"/>", "" }, 1 },
+  { "nested item skipped",    "",                                               "Das Schloss",
+    { "<image><item><title>Bild</title><link>http://example.org/</link><description>Logo</description></item></image>",
+      "" }, 1 },
+  { "stray end tag",          "",                                               "Das Schloss",
+    { "<image><image></image></image>", "" }, 0 },
+};
+
+/*
+ * This function checks which feeds the fast scanner takes, it returns the failures
+*/
+int runScanCases()
+{
+  char feed[1024];
+  rssitems items;
+  int failures = 0;
+  int i;
+
+  initItems(&items);
+  for (i = 0; i < sizeof(scancases) / sizeof(scancase); i++)
+  {
+    scancase* c = &scancases[i];
+
+    snprintf(feed, sizeof(feed), "%s<rss version=\"2.0\"><channel>%s<item><title>%s</title>"
+             "<link>http://example.org/</link><description>Leihfrist</description></item>%s</channel></rss>",
+             c->declaration, c->around[0], c->title, c->around[1]);
+
+    int ok = (scanFeed(feed, strlen(feed), &items) == 1) == c->scanned;
+    printf("%-6s %-22s %s\n", ok ? "ok" : "FAILED", c->name, c->scanned ? "scanned" : "left to libxml2");
+    if (!ok)
+      failures++;
+  }
+
+  // Line ends are normalized like libxml2 does, a referenced CR is kept
+  char* crlf = "<rss><channel><item><title>Das\r\nSchloss\rvon&#13;Kafka</title><link>http://example.org/</link>"
+               "<description>Leihfrist</description></item></channel></rss>";
+  char* title = NULL;
+  if (scanFeed(crlf, strlen(crlf), &items) == 1)
+    title = decodeView(items.items[0].title);
+  int ok = (title != NULL) && !strcmp(title, "Das\nSchloss\nvon\rKafka");
+  printf("%-6s %-22s %s\n", ok ? "ok" : "FAILED", "line ends", "normalized");
+  if (!ok)
+    failures++;
+  free(title);
+  freeItems(&items);
+
+  return failures;
+}
+
+typedef struct
+{
+  int begun;
+  int books;
+  int ended;
+  int commit;
+  feedstats stats;  // Handed over with the end of the update
+} result;
+
+int beginBooks(void* data)
+{
+  ((result*)data)->begun++;
+
+  return 0;
+}
+
+int addBooks(void* data, char* title, char* url, char* date)
+{
+  result* res = data;
+
+  if ((title[0] != 0) && (strlen(date) == 10))
+    res->books++;
+
+  return 0;
+}
+
+int endBooks(void* data, int commit, feedstats* stats)
+{
+  result* res = data;
+
+  res->ended++;
+  res->commit = commit;
+  res->stats = *stats;
+
+  return 0;
+}
+
+/*
+ * This function returns a monotonic timestamp in milliseconds
+*/
+double nowMs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * This function runs a scenario with the given parser, it returns 0 if it ended as
+ * expected and within its time
+*/
+int runScenario(mockserver* server, scenario* s, int fastScan)
+{
+  char url[512];
+  result res = { 0, 0, 0, 0, { 0, 0 } };
+  booksink sink = { &res, beginBooks, addBooks, endBooks };
+
+  listcontext* ctx = newListContext();
+  if (ctx == NULL)
+    return -1;
+
+  snprintf(url, 512, "http://127.0.0.1:%i/feed?%s", mockPort(server), s->query);
+  setPaging(ctx, s->paging, s->window);
+  if (s->budget > 0)
+    setTimeBudget(ctx, s->budget);
+  setFastScan(ctx, fastScan);
+
+  // Without the fetcher, the update blocks the calling thread from start to commit
+  double start = nowMs();
+  int ret = updateList(ctx, url, &sink);
+  double elapsed = nowMs() - start;
+  freeListContext(ctx);
+
+  int ok = (res.ended == 1) && (res.commit == s->commit) && ((ret == 0) == s->commit) &&
+           (!s->commit || (res.books == s->books)) && (elapsed >= s->minMs) && (elapsed <= s->maxMs);
+
+  // Every byte of a plain feed is parsed, a compressed one has to be smaller on the wire
+  if (s->commit)
+  {
+    if (strstr(s->query, "gzip=1") != NULL)
+      ok = ok && (res.stats.feedBytes > 0) && (res.stats.wireBytes * 4 < res.stats.feedBytes);
+    else
+      ok = ok && (res.stats.feedBytes > 0) && (res.stats.wireBytes == res.stats.feedBytes);
+  }
+
+  printf("%-6s %-22s %-9s %5i books %7.1f ms (%.0f-%.0f) %8zu/%zu bytes\n", ok ? "ok" : "FAILED", s->name,
+         fastScan ? "scan" : "libxml2", res.books, elapsed, s->minMs, s->maxMs, res.stats.wireBytes, res.stats.feedBytes);
+
+  return ok ? 0 : -1;
+}
+
+int main()
+{
+  int failures = 0;
+  int i;
+
+  failures += runScanCases();
+  initList();
+
+  mockserver* server = startMockServer();
+  if (server == NULL)
+    return 1;
+
+  // The mistakes of the feed are reported on stderr, only the results are of interest
+  for (i = 0; i < sizeof(scenarios) / sizeof(scenario); i++)
+  {
+    if (runScenario(server, &scenarios[i], 0))
+      failures++;
+    if (runScenario(server, &scenarios[i], 1))
+      failures++;
+  }
+
+  printf("testfeed: %i requests, %i failed\n", mockRequests(server), failures);
+  stopMockServer(server);
+  cleanupList();
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "database.h"
+#include "duedays.h"
+#include <sqlite3.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+int checks = 0;
+int failures = 0;
+
+// What a backend did in testBackend, it has to be the same for all backends
+char journal[16384];
+
+/*
+ * This function records the result of a check and reports it if it failed
+*/
+void check(int ok, char* what)
+{
+  checks++;
+  if (!ok)
+  {
+    failures++;
+    fprintf(stderr, "FAILED: %s\n", what);
+  }
+}
+
+/*
+ * This function appends a line to the journal
+*/
+void note(char* format, ...)
+{
+  va_list args;
+  size_t length = strlen(journal);
+
+  va_start(args, format);
+  vsnprintf(journal + length, sizeof(journal) - length, format, args);
+  va_end(args);
+}
+
+/*
+ * This function formats the day offset days from today as date of the feed
+*/
+char* dateIn(int offset, char* date)
+{
+  int y, m, d;
+
+  civilFromDays(today() + offset, &y, &m, &d);
+  sprintf(date, "%04i-%02i-%02i", y, m, d);
+
+  return date;
+}
+
+/*
+ * This function notes a book found by listBooks or searchBooks
+*/
+void noteBook(char* title, char* url, char* date, void* data)
+{
+  (*(int*)data)++;
+  note("  %s %s %s\n", date, title, url);
+}
+
+/*
+ * This function notes the books found for the search terms in their order, limit is
+ * passed on. It returns the amount of books found.
+*/
+int noteSearch(dbcontext* ctx, char* terms, int limit)
+{
+  int found = 0;
+
+  note("search \"%s\" %i: %i\n", terms, limit, searchBooks(ctx, terms, limit, noteBook, &found));
+  note("  %i found\n", found);
+
+  return found;
+}
+
+/*
+ * This function runs the same sequence on a database of the given backend and checks
+ * the results every backend has to deliver. The journal records everything else, it is
+ * compared between the backends afterwards.
+*/
+void testBackend(char* storage, char* db)
+{
+  static struct { char* title; int offset; } books[] =
+  {
+    { "Der Process", -2 },
+    { "Das Schloss", 0 },
+    { "Amerika", 1 },
+    { "Die Verwandlung", 3 },
+    { "Schlossgeschichten", 7 },
+    { "Das Urteil und andere Erzaehlungen", 30 },
+    { "Das Schloss", 30 },
+    { "Schlösser und Burgen", 12 },
+    { "ÜBER DIE GRENZE", 12 },
+    { "Straße der Café-Häuser", 14 },
+    { "„Zitat“ – ein Roman…", 14 },
+    { "Ελληνικά για αρχάριους", 20 },
+    { "Москва – Петушки", 20 },
+    { "Rabatt 100% sicher", 21 },
+    { "Rabatt 1000 sicher", 21 }
+  };
+  int nbooks = sizeof(books) / sizeof(books[0]);
+  int thresholds[] = { 0, 5 };
+  int counts[4];
+  int indexed[4];
+  char date[11];
+  char url[64];
+  char what[128];
+  duedays dd;
+  feedstats fs = { 0, 0 };
+  int found;
+  int i;
+
+  journal[0] = 0;
+  initDueDays(&dd);
+
+  dbcontext* writing = openDatabase(storage, db);
+  dbcontext* reading = openDatabase(storage, db);
+  snprintf(what, sizeof(what), "%s: the database opens twice", storage);
+  check((writing != NULL) && (reading != NULL), what);
+  if ((writing == NULL) || (reading == NULL))
+    return;
+
+  note("need update %i\n", needUpdate(writing, 10));
+  snprintf(what, sizeof(what), "%s: no bytes are recorded before the first update", storage);
+  check(!getFeedStats(reading, &fs) && (fs.wireBytes == 0) && (fs.feedBytes == 0), what);
+  note("changed %i\n", dataChanged(reading));
+  note("changed %i\n", dataChanged(reading));
+  note("changed %i\n", dataChanged(writing));
+
+  // A committed snapshot is seen by the other connection only
+  note("begin %i\n", beginTransaction(writing));
+  note("clear %i\n", clearBooklist(writing));
+  for (i = 0; i < nbooks; i++)
+  {
+    snprintf(url, sizeof(url), "http://example.org/book/%i", i);
+    note("add %i\n", addBook(writing, books[i].title, url, dateIn(books[i].offset, date)));
+  }
+  note("end %i\n", endTransaction(writing));
+  snprintf(what, sizeof(what), "%s: a connection doesn't see its own commit as change", storage);
+  check(dataChanged(writing) == 0, what);
+  snprintf(what, sizeof(what), "%s: a commit is seen by the other connection once", storage);
+  check((dataChanged(reading) == 1) && (dataChanged(reading) == 0), what);
+
+  // An aborted snapshot leaves no trace
+  note("begin %i\n", beginTransaction(writing));
+  note("clear %i\n", clearBooklist(writing));
+  note("add %i\n", addBook(writing, "Nicht gespeichert", "http://example.org/none", dateIn(0, date)));
+  note("abort %i\n", abortTransaction(writing));
+  snprintf(what, sizeof(what), "%s: an aborted transaction changes nothing", storage);
+  check(dataChanged(reading) == 0, what);
+
+  // The due dates and their buckets, counted both ways
+  snprintf(what, sizeof(what), "%s: all committed due dates are loaded", storage);
+  check(!loadDueDays(reading, &dd) && (dd.count == nbooks), what);
+  countBuckets(&dd, today(), thresholds, 2, counts);
+  snprintf(what, sizeof(what), "%s: the backend counts the buckets like countBuckets", storage);
+  check(!countDueBooks(reading, today(), thresholds, 2, indexed) && !memcmp(counts, indexed, sizeof(counts)), what);
+  snprintf(what, sizeof(what), "%s: the books are sorted into late, today, soon and ok", storage);
+  check((counts[0] == 1) && (counts[1] == 1) && (counts[2] == 2) && (counts[3] == nbooks - 4), what);
+  note("buckets %i %i %i %i\n", counts[0], counts[1], counts[2], counts[3]);
+
+  // An update is recorded for all connections
+  fs.wireBytes = 4321;
+  fs.feedBytes = (size_t)5 << 32;
+  note("update done %i\n", updateDone(writing, &fs));
+  snprintf(what, sizeof(what), "%s: an update is not needed right after one", storage);
+  check(needUpdate(reading, 10) == 0, what);
+  snprintf(what, sizeof(what), "%s: the bytes of the update are recorded", storage);
+  check(!getFeedStats(reading, &fs) && (fs.wireBytes == 4321) && (fs.feedBytes == (size_t)5 << 32), what);
+
+  found = 0;
+  note("list 3: %i\n", listBooks(reading, 3, noteBook, &found));
+  found = 0;
+  note("list all: %i\n", listBooks(reading, -1, noteBook, &found));
+  snprintf(what, sizeof(what), "%s: all books are listed", storage);
+  check(found == nbooks, what);
+
+  // Ranking: whole words first, then the date, then the title
+  noteSearch(reading, "schloss", -1);
+  noteSearch(reading, "Schloss", 1);
+  noteSearch(reading, "das", -1);
+  noteSearch(reading, "verw", -1);
+  noteSearch(reading, "das schl", -1);
+  noteSearch(reading, "kafka", -1);
+
+  // Case and diacritics are folded, punctuation separates words
+  snprintf(what, sizeof(what), "%s: diacritics and case are folded", storage);
+  check((noteSearch(reading, "schlosser", -1) == 1) && (noteSearch(reading, "uber grenze", -1) == 1) &&
+        (noteSearch(reading, "CAFE haus", -1) == 1) && (noteSearch(reading, "ΕΛΛΗΝΙΚΆ", -1) == 1) &&
+        (noteSearch(reading, "МОСКВА", -1) == 1), what);
+  snprintf(what, sizeof(what), "%s: punctuation separates words", storage);
+  check((noteSearch(reading, "zitat roman", -1) == 1) && (noteSearch(reading, "„zitat“", -1) == 1) &&
+        (noteSearch(reading, "petushki", -1) == 0) && (noteSearch(reading, "петушки", -1) == 1), what);
+  snprintf(what, sizeof(what), "%s: ß is kept like in the full-text index", storage);
+  check((noteSearch(reading, "strasse", -1) == 0) && (noteSearch(reading, "straße", -1) == 1), what);
+  snprintf(what, sizeof(what), "%s: wildcards are no words", storage);
+  check((noteSearch(reading, "100%", -1) == 2) && (noteSearch(reading, "%", -1) == 0), what);
+
+  // A book added without clearing the list first keeps the others, an empty transaction
+  // changes nothing
+  note("add alone %i\n", addBook(writing, "Nachtrag", "http://example.org/late", dateIn(40, date)));
+  found = 0;
+  note("list all: %i\n", listBooks(reading, -1, noteBook, &found));
+  snprintf(what, sizeof(what), "%s: a book added on its own keeps the others", storage);
+  check(found == nbooks + 1, what);
+  note("changed %i\n", dataChanged(reading));
+  note("begin %i\n", beginTransaction(writing));
+  note("commit %i\n", endTransaction(writing));
+  snprintf(what, sizeof(what), "%s: an empty transaction changes nothing", storage);
+  check(dataChanged(reading) == 0, what);
+
+  freeDueDays(&dd);
+  closeDatabase(reading);
+  closeDatabase(writing);
+}
+
+/*
+ * This function checks the search of sqlite databases without full-text index, the same
+ * books have to be found as with it
+*/
+void testWithoutIndex(char* db)
+{
+  static char* searches[] = { "schloss", "das schl", "verw", "schlosser", "uber grenze", "CAFE haus", "ΕΛΛΗΝΙΚΆ",
+                              "petushki", "петушки", "straße", "„zitat“", "100%", "%", "Rabatt 10_0", "Rabatt 1" };
+  int nsearches = sizeof(searches) / sizeof(searches[0]);
+  char indexed[sizeof(journal)];
+  sqlite3* database;
+  int i;
+
+  journal[0] = 0;
+  dbcontext* ctx = openDatabaseReadOnly("sqlite", db);
+  check(ctx != NULL, "sqlite: the database opens read-only");
+  if (ctx == NULL)
+    return;
+  for (i = 0; i < nsearches; i++)
+    noteSearch(ctx, searches[i], -1);
+  closeDatabase(ctx);
+  strcpy(indexed, journal);
+
+  check((sqlite3_open(db, &database) == SQLITE_OK) &&
+        (sqlite3_exec(database, "DROP TRIGGER books_fts_insert; DROP TRIGGER books_fts_delete; "
+                                "DROP TRIGGER books_fts_update; DROP TABLE books_fts;", NULL, NULL, NULL) == SQLITE_OK),
+        "sqlite: the full-text index can be dropped");
+  sqlite3_close(database);
+
+  journal[0] = 0;
+  ctx = openDatabaseReadOnly("sqlite", db);
+  check(ctx != NULL, "sqlite: the database opens without full-text index");
+  if (ctx == NULL)
+    return;
+  for (i = 0; i < nsearches; i++)
+    noteSearch(ctx, searches[i], -1);
+  closeDatabase(ctx);
+
+  check(!strcmp(indexed, journal), "sqlite: the same books are found without full-text index");
+  if (strcmp(indexed, journal))
+    fprintf(stderr, "with index:\n%s\nwithout index:\n%s\n", indexed, journal);
+}
+
+int main()
+{
+  char db[64];
+  char first[sizeof(journal)];
+
+  snprintf(db, sizeof(db), "/tmp/teststorage-%i.db", (int)getpid());
+  unlink(db);
+
+  testBackend("sqlite", db);
+  strcpy(first, journal);
+  testWithoutIndex(db);
+  unlink(db);
+
+  testBackend("memory", db);
+  check(!strcmp(first, journal), "sqlite and memory deliver the same results");
+  if (strcmp(first, journal))
+    fprintf(stderr, "sqlite:\n%s\nmemory:\n%s\n", first, journal);
+
+  printf("teststorage: %i checks, %i failed\n", checks, failures);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "timerwheel.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_TIMERS 64
+
+int checks = 0;
+int failures = 0;
+
+typedef struct
+{
+  timerwheel* wheel;
+  uint64_t due;     // Tick the timer has to fire on
+  uint64_t fired;   // Tick it fired on
+  int done;
+} testtimer;
+
+/*
+ * This function records the result of a check and reports it if it failed
+*/
+void check(int ok, char* what)
+{
+  checks++;
+  if (!ok)
+  {
+    failures++;
+    fprintf(stderr, "FAILED: %s\n", what);
+  }
+}
+
+/*
+ * This function records the tick a timer fired on
+*/
+void fireTimer(wheeltimer* timer, void* data)
+{
+  testtimer* t = data;
+
+  t->fired = t->wheel->now;
+  t->done = 1;
+}
+
+/*
+ * This function returns the next number of a simple pseudo random sequence
+*/
+uint64_t nextRandom(uint64_t* state)
+{
+  *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+  return *state >> 33;
+}
+
+/*
+ * This function runs the wheel like the reminders do: it is only advanced to the ticks
+ * nextExpiry returns. Every timer has to fire on its tick, so nextExpiry must never
+ * return a tick later than the earliest pending timer. It returns 0 if all went well.
+*/
+int runWheel(uint64_t start, uint64_t* delays, int count)
+{
+  timerwheel wheel;
+  wheeltimer timers[TEST_TIMERS];
+  testtimer tests[TEST_TIMERS];
+  uint64_t tick;
+  int late = 0;
+  int i;
+
+  initWheel(&wheel, start);
+  for (i = 0; i < count; i++)
+  {
+    tests[i].wheel = &wheel;
+    tests[i].due = start + delays[i];
+    tests[i].fired = 0;
+    tests[i].done = 0;
+    initTimer(&timers[i], fireTimer, &tests[i]);
+    addTimer(&wheel, &timers[i], tests[i].due);
+  }
+
+  while (nextExpiry(&wheel, &tick))
+  {
+    uint64_t earliest = 0;
+    int pending = 0;
+
+    for (i = 0; i < count; i++)
+    {
+      if (!tests[i].done && (!pending || (tests[i].due < earliest)))
+        earliest = tests[i].due;
+      pending |= !tests[i].done;
+    }
+
+    if (!pending || (tick > earliest))
+      return -1;
+
+    advanceWheel(&wheel, tick);
+  }
+
+  for (i = 0; i < count; i++)
+    late |= !tests[i].done || (tests[i].fired != tests[i].due);
+
+  return late ? -1 : 0;
+}
+
+/*
+ * This function checks the timers of a cascade that is due on the current tick
+*/
+void testBoundary()
+{
+  uint64_t delays[] = { 1136, 1599, 1652 };
+
+  check(runWheel(29000000, delays, 3) == 0, "a timer cascaded on the current tick is not skipped");
+}
+
+/*
+ * This function checks random timers on all levels, started on and off block boundaries
+*/
+void testRandom()
+{
+  uint64_t starts[] = { 0, 1, 63, 64, 4096, 262144, 29000000, 29001600, 1735689600 };
+  int nstarts = sizeof(starts) / sizeof(starts[0]);
+  uint64_t delays[TEST_TIMERS];
+  uint64_t state = 1;
+  int failed = 0;
+  int round, s, i;
+
+  for (s = 0; s < nstarts; s++)
+  {
+    for (round = 0; round < 200; round++)
+    {
+      for (i = 0; i < TEST_TIMERS; i++)
+      {
+        // Delays of every level, the last one ends 64^4 ticks ahead
+        uint64_t range = 1ULL << (WHEEL_BITS * (1 + nextRandom(&state) % WHEEL_LEVELS));
+        delays[i] = nextRandom(&state) % range;
+      }
+      failed |= runWheel(starts[s], delays, TEST_TIMERS);
+    }
+  }
+
+  check(!failed, "random timers fire on their tick and nextExpiry never passes them");
+}
+
+int main()
+{
+  testBoundary();
+  testRandom();
+
+  printf("testtimerwheel: %i checks, %i failed\n", checks, failures);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "timerwheel.h"
+#include <stddef.h>
+#include <string.h>
+
+#define SLOT_MASK (WHEEL_SLOTS - 1)
+
+/*
+ * This function returns the slot index of tick on the given level
+*/
+int slotIndex(uint64_t tick, int level)
+{
+  return (tick >> (level * WHEEL_BITS)) & SLOT_MASK;
+}
+
+/*
+ * This function initializes an empty wheel, now is the first tick to be processed
+*/
+void initWheel(timerwheel* wheel, uint64_t now)
+{
+  memset(wheel, 0, sizeof(timerwheel));
+  wheel->now = now;
+}
+
+/*
+ * This function initializes a timer, fire is called with data when it expires
+*/
+void initTimer(wheeltimer* timer, void (*fire)(wheeltimer* timer, void* data), void* data)
+{
+  timer->next = NULL;
+  timer->pprev = NULL;
+  timer->expires = 0;
+  timer->fire = fire;
+  timer->data = data;
+}
+
+/*
+ * This function links a timer into the slot it belongs to. Timers further away are kept
+ * on the coarser levels and moved down (cascaded) when their slot comes up.
+*/
+void placeTimer(timerwheel* wheel, wheeltimer* timer)
+{
+  uint64_t expires = timer->expires;
+  uint64_t delta = expires > wheel->now ? expires - wheel->now : 0;
+  uint64_t range = WHEEL_SLOTS;
+  int level = 0;
+
+  // Timers in the past expire with the current tick
+  if (delta == 0)
+    expires = wheel->now;
+
+  while ((level < WHEEL_LEVELS - 1) && (delta >= range))
+  {
+    range <<= WHEEL_BITS;
+    level++;
+  }
+
+  // Timers beyond the last level wait in its furthest slot
+  if (delta >= range)
+    expires = wheel->now + range - 1;
+
+  int index = slotIndex(expires, level);
+  wheeltimer** slot = &wheel->slots[level][index];
+
+  timer->next = *slot;
+  if (*slot != NULL)
+    (*slot)->pprev = &timer->next;
+  timer->pprev = slot;
+  *slot = timer;
+  wheel->occupied[level] |= 1ULL << index;
+}
+
+/*
+ * This function unlinks a timer and updates the bitmap of its slot
+*/
+void unlinkTimer(timerwheel* wheel, wheeltimer* timer)
+{
+  int level, index;
+
+  *timer->pprev = timer->next;
+  if (timer->next != NULL)
+    timer->next->pprev = timer->pprev;
+
+  // Find the slot by its address to clear the bit if it became empty. If the timer
+  // wasn't the first one of its slot, the slot can't be empty.
+  for (level = 0; level < WHEEL_LEVELS; level++)
+  {
+    wheeltimer** first = &wheel->slots[level][0];
+    if ((timer->pprev >= first) && (timer->pprev < first + WHEEL_SLOTS))
+    {
+      index = timer->pprev - first;
+      if (wheel->slots[level][index] == NULL)
+        wheel->occupied[level] &= ~(1ULL << index);
+      break;
+    }
+  }
+
+  timer->next = NULL;
+  timer->pprev = NULL;
+}
+
+/*
+ * This function schedules a timer to expire at the given tick, a pending timer is moved
+*/
+void addTimer(timerwheel* wheel, wheeltimer* timer, uint64_t expires)
+{
+  if (timerPending(timer))
+    unlinkTimer(wheel, timer);
+
+  timer->expires = expires;
+  placeTimer(wheel, timer);
+}
+
+/*
+ * This function cancels a timer, it does nothing if the timer isn't pending
+*/
+void removeTimer(timerwheel* wheel, wheeltimer* timer)
+{
+  if (timerPending(timer))
+    unlinkTimer(wheel, timer);
+}
+
+/*
+ * This function returns 1 if the timer is scheduled
+*/
+int timerPending(wheeltimer* timer)
+{
+  return timer->pprev != NULL;
+}
+
+/*
+ * This function takes all timers from a slot and places them again, relative to now
+*/
+void cascade(timerwheel* wheel, int level, int index)
+{
+  wheeltimer* timer = wheel->slots[level][index];
+
+  wheel->slots[level][index] = NULL;
+  wheel->occupied[level] &= ~(1ULL << index);
+
+  while (timer != NULL)
+  {
+    wheeltimer* next = timer->next;
+    placeTimer(wheel, timer);
+    timer = next;
+  }
+}
+
+/*
+ * This function processes all ticks up to and including target and fires the timers
+ * expiring on them. Ticks without timers are skipped, so advancing over long idle
+ * periods costs only one step per 64 ticks at most.
+*/
+void advanceWheel(timerwheel* wheel, uint64_t target)
+{
+  while (wheel->now <= target)
+  {
+    uint64_t tick = wheel->now;
+    int index = slotIndex(tick, 0);
+    int level;
+
+    // Move the timers of the coarser levels down when their slot comes up
+    for (level = 1; (level < WHEEL_LEVELS) && (slotIndex(tick, level - 1) == 0); level++)
+      cascade(wheel, level, slotIndex(tick, level));
+
+    // Fire the timers of this tick, timers added by them for this tick fire as well
+    while (wheel->slots[0][index] != NULL)
+    {
+      wheeltimer* timer = wheel->slots[0][index];
+
+      unlinkTimer(wheel, timer);
+      timer->fire(timer, timer->data);
+    }
+
+    // Skip to the next tick with timers or the next boundary of the first level
+    uint64_t later = index == SLOT_MASK ? 0 : wheel->occupied[0] & (~0ULL << (index + 1));
+    uint64_t next = later ? (tick & ~(uint64_t)SLOT_MASK) + __builtin_ctzll(later) : (tick | SLOT_MASK) + 1;
+
+    if (next > target)
+    {
+      wheel->now = target + 1;
+      break;
+    }
+    wheel->now = next;
+  }
+}
+
+/*
+ * This function returns the tick the wheel has to be advanced to next in tick. This is
+ * the expiry of the next timer or an earlier tick on which timers of a coarser level are
+ * cascaded. It returns 0 if no timer is pending.
+*/
+int nextExpiry(timerwheel* wheel, uint64_t* tick)
+{
+  int level;
+  int found = 0;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+  {
+    int shift = level * WHEEL_BITS;
+    int index = slotIndex(wheel->now, level);
+    uint64_t block = (wheel->now >> shift) & ~(uint64_t)SLOT_MASK;
+    uint64_t bits = wheel->occupied[level];
+    uint64_t slot;
+
+    if (bits == 0)
+      continue;
+
+    // Slots from the current index on belong to this rotation, the others to the next one.
+    // The current slot of a coarser level was cascaded already, unless now is the first
+    // tick of its block, which is processed next.
+    uint64_t ahead = bits & (~0ULL << index);
+    if ((level > 0) && (wheel->now & ((1ULL << shift) - 1)))
+      ahead &= ~(1ULL << index);
+
+    if (ahead)
+      slot = block + __builtin_ctzll(ahead);
+    else
+      slot = block + WHEEL_SLOTS + __builtin_ctzll(bits);
+
+    uint64_t when = slot << shift;
+    if (when < wheel->now)
+      when = wheel->now;
+
+    if (!found || (when < *tick))
+      *tick = when;
+    found = 1;
+  }
+
+  return found;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TIMERWHEEL_H
+#define _TIMERWHEEL_H
+
+#include <stdint.h>
+
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+
+typedef struct wheeltimer
+{
+  struct wheeltimer* next;
+  struct wheeltimer** pprev;
+  uint64_t expires;
+  void (*fire)(struct wheeltimer* timer, void* data);
+  void* data;
+} wheeltimer;
+
+// Slot s of level l holds timers expiring within 64^l ticks, starting at tick s * 64^l
+typedef struct
+{
+  wheeltimer* slots[WHEEL_LEVELS][WHEEL_SLOTS];
+  uint64_t occupied[WHEEL_LEVELS];
+  uint64_t now;
+} timerwheel;
+
+void initWheel(timerwheel* wheel, uint64_t now);
+void initTimer(wheeltimer* timer, void (*fire)(wheeltimer* timer, void* data), void* data);
+void addTimer(timerwheel* wheel, wheeltimer* timer, uint64_t expires);
+void removeTimer(timerwheel* wheel, wheeltimer* timer);
+int timerPending(wheeltimer* timer);
+void advanceWheel(timerwheel* wheel, uint64_t target);
+int nextExpiry(timerwheel* wheel, uint64_t* tick);
+
+#endif // _TIMERWHEEL_H
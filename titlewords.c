@@ -0,0 +1,355 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "titlewords.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+
+// Characters between words and combining marks, which are dropped from words
+#define SEP 0
+#define DRP 1
+
+/*
+ * The folding of SQLite's unicode61 tokenizer with remove_diacritics 2 for the Latin,
+ * Greek and Cyrillic letters: every character maps to its lower case letter without
+ * diacritics, to SEP or to DRP. The two letters whose lower case needs more bytes in
+ * UTF-8 (U+023A and U+023E) are kept, so the folding can be done in place.
+*/
+const uint16_t foldLatin[0x0530 - 0x0080] =
+{
+  /* 0080 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0088 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0090 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0098 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 00A0 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 00A8 */ SEP, SEP, 0x00aa, SEP, SEP, SEP, SEP, SEP,
+  /* 00B0 */ SEP, SEP, 0x00b2, 0x00b3, SEP, 0x03bc, SEP, SEP,
+  /* 00B8 */ SEP, 0x00b9, 0x00ba, SEP, 0x00bc, 0x00bd, 0x00be, SEP,
+  /* 00C0 */ 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x00e6, 0x0063,
+  /* 00C8 */ 0x0065, 0x0065, 0x0065, 0x0065, 0x0069, 0x0069, 0x0069, 0x0069,
+  /* 00D0 */ 0x00f0, 0x006e, 0x006f, 0x006f, 0x006f, 0x006f, 0x006f, SEP,
+  /* 00D8 */ 0x00f8, 0x0075, 0x0075, 0x0075, 0x0075, 0x0079, 0x00fe, 0x00df,
+  /* 00E0 */ 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x00e6, 0x0063,
+  /* 00E8 */ 0x0065, 0x0065, 0x0065, 0x0065, 0x0069, 0x0069, 0x0069, 0x0069,
+  /* 00F0 */ 0x00f0, 0x006e, 0x006f, 0x006f, 0x006f, 0x006f, 0x006f, SEP,
+  /* 00F8 */ 0x00f8, 0x0075, 0x0075, 0x0075, 0x0075, 0x0079, 0x00fe, 0x0079,
+  /* 0100 */ 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0063, 0x0063,
+  /* 0108 */ 0x0063, 0x0063, 0x0063, 0x0063, 0x0063, 0x0063, 0x0064, 0x0064,
+  /* 0110 */ 0x0111, 0x0111, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065,
+  /* 0118 */ 0x0065, 0x0065, 0x0065, 0x0065, 0x0067, 0x0067, 0x0067, 0x0067,
+  /* 0120 */ 0x0067, 0x0067, 0x0067, 0x0067, 0x0068, 0x0068, 0x0127, 0x0127,
+  /* 0128 */ 0x0069, 0x0069, 0x0069, 0x0069, 0x0069, 0x0069, 0x0069, 0x0069,
+  /* 0130 */ 0x0069, 0x0131, 0x0133, 0x0133, 0x006a, 0x006a, 0x006b, 0x006b,
+  /* 0138 */ 0x0138, 0x006c, 0x006c, 0x006c, 0x006c, 0x006c, 0x006c, 0x0140,
+  /* 0140 */ 0x0140, 0x0142, 0x0142, 0x006e, 0x006e, 0x006e, 0x006e, 0x006e,
+  /* 0148 */ 0x006e, 0x0149, 0x014b, 0x014b, 0x006f, 0x006f, 0x006f, 0x006f,
+  /* 0150 */ 0x006f, 0x006f, 0x0153, 0x0153, 0x0072, 0x0072, 0x0072, 0x0072,
+  /* 0158 */ 0x0072, 0x0072, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073,
+  /* 0160 */ 0x0073, 0x0073, 0x0074, 0x0074, 0x0074, 0x0074, 0x0167, 0x0167,
+  /* 0168 */ 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075,
+  /* 0170 */ 0x0075, 0x0075, 0x0075, 0x0075, 0x0077, 0x0077, 0x0079, 0x0079,
+  /* 0178 */ 0x0079, 0x007a, 0x007a, 0x007a, 0x007a, 0x007a, 0x007a, 0x0073,
+  /* 0180 */ 0x0180, 0x0253, 0x0183, 0x0183, 0x0185, 0x0185, 0x0254, 0x0188,
+  /* 0188 */ 0x0188, 0x0256, 0x0257, 0x018c, 0x018c, 0x018d, 0x01dd, 0x0259,
+  /* 0190 */ 0x025b, 0x0192, 0x0192, 0x0260, 0x0263, 0x0195, 0x0269, 0x0268,
+  /* 0198 */ 0x0199, 0x0199, 0x019a, 0x019b, 0x026f, 0x0272, 0x019e, 0x0275,
+  /* 01A0 */ 0x006f, 0x006f, 0x01a3, 0x01a3, 0x01a5, 0x01a5, 0x0280, 0x01a8,
+  /* 01A8 */ 0x01a8, 0x0283, 0x01aa, 0x01ab, 0x01ad, 0x01ad, 0x0288, 0x0075,
+  /* 01B0 */ 0x0075, 0x028a, 0x028b, 0x01b4, 0x01b4, 0x01b6, 0x01b6, 0x0292,
+  /* 01B8 */ 0x01b9, 0x01b9, 0x01ba, 0x01bb, 0x01bd, 0x01bd, 0x01be, 0x01bf,
+  /* 01C0 */ 0x01c0, 0x01c1, 0x01c2, 0x01c3, 0x01c6, 0x01c6, 0x01c6, 0x01c9,
+  /* 01C8 */ 0x01c9, 0x01c9, 0x01cc, 0x01cc, 0x01cc, 0x0061, 0x0061, 0x0069,
+  /* 01D0 */ 0x0069, 0x006f, 0x006f, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075,
+  /* 01D8 */ 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x01dd, 0x0061, 0x0061,
+  /* 01E0 */ 0x01e1, 0x01e1, 0x01e3, 0x01e3, 0x01e5, 0x01e5, 0x0067, 0x0067,
+  /* 01E8 */ 0x006b, 0x006b, 0x006f, 0x006f, 0x006f, 0x006f, 0x01ef, 0x01ef,
+  /* 01F0 */ 0x006a, 0x01f3, 0x01f3, 0x01f3, 0x0067, 0x0067, 0x0195, 0x01bf,
+  /* 01F8 */ 0x006e, 0x006e, 0x0061, 0x0061, 0x01fd, 0x01fd, 0x01ff, 0x01ff,
+  /* 0200 */ 0x0061, 0x0061, 0x0061, 0x0061, 0x0065, 0x0065, 0x0065, 0x0065,
+  /* 0208 */ 0x0069, 0x0069, 0x0069, 0x0069, 0x006f, 0x006f, 0x006f, 0x006f,
+  /* 0210 */ 0x0072, 0x0072, 0x0072, 0x0072, 0x0075, 0x0075, 0x0075, 0x0075,
+  /* 0218 */ 0x0073, 0x0073, 0x0074, 0x0074, 0x021d, 0x021d, 0x0068, 0x0068,
+  /* 0220 */ 0x019e, 0x0221, 0x0223, 0x0223, 0x0225, 0x0225, 0x0061, 0x0061,
+  /* 0228 */ 0x0065, 0x0065, 0x006f, 0x006f, 0x006f, 0x006f, 0x006f, 0x006f,
+  /* 0230 */ 0x006f, 0x006f, 0x0079, 0x0079, 0x0234, 0x0235, 0x0236, 0x0237,
+  /* 0238 */ 0x0238, 0x0239, 0x023a, 0x023c, 0x023c, 0x019a, 0x023e, 0x023f,
+  /* 0240 */ 0x0240, 0x0242, 0x0242, 0x0180, 0x0289, 0x028c, 0x0247, 0x0247,
+  /* 0248 */ 0x0249, 0x0249, 0x024b, 0x024b, 0x024d, 0x024d, 0x024f, 0x024f,
+  /* 0250 */ 0x0250, 0x0251, 0x0252, 0x0253, 0x0254, 0x0255, 0x0256, 0x0257,
+  /* 0258 */ 0x0258, 0x0259, 0x025a, 0x025b, 0x025c, 0x025d, 0x025e, 0x025f,
+  /* 0260 */ 0x0260, 0x0261, 0x0262, 0x0263, 0x0264, 0x0265, 0x0266, 0x0267,
+  /* 0268 */ 0x0268, 0x0269, 0x026a, 0x026b, 0x026c, 0x026d, 0x026e, 0x026f,
+  /* 0270 */ 0x0270, 0x0271, 0x0272, 0x0273, 0x0274, 0x0275, 0x0276, 0x0277,
+  /* 0278 */ 0x0278, 0x0279, 0x027a, 0x027b, 0x027c, 0x027d, 0x027e, 0x027f,
+  /* 0280 */ 0x0280, 0x0281, 0x0282, 0x0283, 0x0284, 0x0285, 0x0286, 0x0287,
+  /* 0288 */ 0x0288, 0x0289, 0x028a, 0x028b, 0x028c, 0x028d, 0x028e, 0x028f,
+  /* 0290 */ 0x0290, 0x0291, 0x0292, 0x0293, 0x0294, 0x0295, 0x0296, 0x0297,
+  /* 0298 */ 0x0298, 0x0299, 0x029a, 0x029b, 0x029c, 0x029d, 0x029e, 0x029f,
+  /* 02A0 */ 0x02a0, 0x02a1, 0x02a2, 0x02a3, 0x02a4, 0x02a5, 0x02a6, 0x02a7,
+  /* 02A8 */ 0x02a8, 0x02a9, 0x02aa, 0x02ab, 0x02ac, 0x02ad, 0x02ae, 0x02af,
+  /* 02B0 */ 0x02b0, 0x02b1, 0x02b2, 0x02b3, 0x02b4, 0x02b5, 0x02b6, 0x02b7,
+  /* 02B8 */ 0x02b8, 0x02b9, 0x02ba, 0x02bb, 0x02bc, 0x02bd, 0x02be, 0x02bf,
+  /* 02C0 */ 0x02c0, 0x02c1, SEP, SEP, SEP, SEP, 0x02c6, 0x02c7,
+  /* 02C8 */ 0x02c8, 0x02c9, 0x02ca, 0x02cb, 0x02cc, 0x02cd, 0x02ce, 0x02cf,
+  /* 02D0 */ 0x02d0, 0x02d1, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 02D8 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 02E0 */ 0x02e0, 0x02e1, 0x02e2, 0x02e3, 0x02e4, SEP, SEP, SEP,
+  /* 02E8 */ SEP, SEP, SEP, SEP, 0x02ec, SEP, 0x02ee, SEP,
+  /* 02F0 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 02F8 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0300 */ DRP, DRP, DRP, DRP, DRP, SEP, DRP, DRP,
+  /* 0308 */ DRP, DRP, DRP, DRP, DRP, SEP, SEP, DRP,
+  /* 0310 */ SEP, DRP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0318 */ SEP, SEP, SEP, DRP, SEP, SEP, SEP, SEP,
+  /* 0320 */ SEP, SEP, SEP, DRP, DRP, DRP, DRP, DRP,
+  /* 0328 */ DRP, SEP, SEP, SEP, SEP, DRP, DRP, SEP,
+  /* 0330 */ DRP, DRP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0338 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0340 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0348 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0350 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0358 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0360 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0368 */ SEP, SEP, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0370 */ 0x0371, 0x0371, 0x0373, 0x0373, 0x0374, SEP, 0x0377, 0x0377,
+  /* 0378 */ 0x0378, 0x0379, 0x037a, 0x037b, 0x037c, 0x037d, SEP, 0x037f,
+  /* 0380 */ 0x0380, 0x0381, 0x0382, 0x0383, SEP, SEP, 0x03ac, SEP,
+  /* 0388 */ 0x03ad, 0x03ae, 0x03af, 0x038b, 0x03cc, 0x038d, 0x03cd, 0x03ce,
+  /* 0390 */ 0x0390, 0x03b1, 0x03b2, 0x03b3, 0x03b4, 0x03b5, 0x03b6, 0x03b7,
+  /* 0398 */ 0x03b8, 0x03b9, 0x03ba, 0x03bb, 0x03bc, 0x03bd, 0x03be, 0x03bf,
+  /* 03A0 */ 0x03c0, 0x03c1, 0x03a2, 0x03c3, 0x03c4, 0x03c5, 0x03c6, 0x03c7,
+  /* 03A8 */ 0x03c8, 0x03c9, 0x03ca, 0x03cb, 0x03ac, 0x03ad, 0x03ae, 0x03af,
+  /* 03B0 */ 0x03b0, 0x03b1, 0x03b2, 0x03b3, 0x03b4, 0x03b5, 0x03b6, 0x03b7,
+  /* 03B8 */ 0x03b8, 0x03b9, 0x03ba, 0x03bb, 0x03bc, 0x03bd, 0x03be, 0x03bf,
+  /* 03C0 */ 0x03c0, 0x03c1, 0x03c3, 0x03c3, 0x03c4, 0x03c5, 0x03c6, 0x03c7,
+  /* 03C8 */ 0x03c8, 0x03c9, 0x03ca, 0x03cb, 0x03cc, 0x03cd, 0x03ce, 0x03d7,
+  /* 03D0 */ 0x03b2, 0x03b8, 0x03d2, 0x03d3, 0x03d4, 0x03c6, 0x03c0, 0x03d7,
+  /* 03D8 */ 0x03d9, 0x03d9, 0x03db, 0x03db, 0x03dd, 0x03dd, 0x03df, 0x03df,
+  /* 03E0 */ 0x03e1, 0x03e1, 0x03e3, 0x03e3, 0x03e5, 0x03e5, 0x03e7, 0x03e7,
+  /* 03E8 */ 0x03e9, 0x03e9, 0x03eb, 0x03eb, 0x03ed, 0x03ed, 0x03ef, 0x03ef,
+  /* 03F0 */ 0x03ba, 0x03c1, 0x03f2, 0x03f3, 0x03b8, 0x03b5, SEP, 0x03f8,
+  /* 03F8 */ 0x03f8, 0x03f2, 0x03fb, 0x03fb, 0x03fc, 0x037b, 0x037c, 0x037d,
+  /* 0400 */ 0x0450, 0x0451, 0x0452, 0x0453, 0x0454, 0x0455, 0x0456, 0x0457,
+  /* 0408 */ 0x0458, 0x0459, 0x045a, 0x045b, 0x045c, 0x045d, 0x045e, 0x045f,
+  /* 0410 */ 0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+  /* 0418 */ 0x0438, 0x0439, 0x043a, 0x043b, 0x043c, 0x043d, 0x043e, 0x043f,
+  /* 0420 */ 0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+  /* 0428 */ 0x0448, 0x0449, 0x044a, 0x044b, 0x044c, 0x044d, 0x044e, 0x044f,
+  /* 0430 */ 0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+  /* 0438 */ 0x0438, 0x0439, 0x043a, 0x043b, 0x043c, 0x043d, 0x043e, 0x043f,
+  /* 0440 */ 0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+  /* 0448 */ 0x0448, 0x0449, 0x044a, 0x044b, 0x044c, 0x044d, 0x044e, 0x044f,
+  /* 0450 */ 0x0450, 0x0451, 0x0452, 0x0453, 0x0454, 0x0455, 0x0456, 0x0457,
+  /* 0458 */ 0x0458, 0x0459, 0x045a, 0x045b, 0x045c, 0x045d, 0x045e, 0x045f,
+  /* 0460 */ 0x0461, 0x0461, 0x0463, 0x0463, 0x0465, 0x0465, 0x0467, 0x0467,
+  /* 0468 */ 0x0469, 0x0469, 0x046b, 0x046b, 0x046d, 0x046d, 0x046f, 0x046f,
+  /* 0470 */ 0x0471, 0x0471, 0x0473, 0x0473, 0x0475, 0x0475, 0x0477, 0x0477,
+  /* 0478 */ 0x0479, 0x0479, 0x047b, 0x047b, 0x047d, 0x047d, 0x047f, 0x047f,
+  /* 0480 */ 0x0481, 0x0481, SEP, SEP, SEP, SEP, SEP, SEP,
+  /* 0488 */ SEP, SEP, 0x048b, 0x048b, 0x048d, 0x048d, 0x048f, 0x048f,
+  /* 0490 */ 0x0491, 0x0491, 0x0493, 0x0493, 0x0495, 0x0495, 0x0497, 0x0497,
+  /* 0498 */ 0x0499, 0x0499, 0x049b, 0x049b, 0x049d, 0x049d, 0x049f, 0x049f,
+  /* 04A0 */ 0x04a1, 0x04a1, 0x04a3, 0x04a3, 0x04a5, 0x04a5, 0x04a7, 0x04a7,
+  /* 04A8 */ 0x04a9, 0x04a9, 0x04ab, 0x04ab, 0x04ad, 0x04ad, 0x04af, 0x04af,
+  /* 04B0 */ 0x04b1, 0x04b1, 0x04b3, 0x04b3, 0x04b5, 0x04b5, 0x04b7, 0x04b7,
+  /* 04B8 */ 0x04b9, 0x04b9, 0x04bb, 0x04bb, 0x04bd, 0x04bd, 0x04bf, 0x04bf,
+  /* 04C0 */ 0x04cf, 0x04c2, 0x04c2, 0x04c4, 0x04c4, 0x04c6, 0x04c6, 0x04c8,
+  /* 04C8 */ 0x04c8, 0x04ca, 0x04ca, 0x04cc, 0x04cc, 0x04ce, 0x04ce, 0x04cf,
+  /* 04D0 */ 0x04d1, 0x04d1, 0x04d3, 0x04d3, 0x04d5, 0x04d5, 0x04d7, 0x04d7,
+  /* 04D8 */ 0x04d9, 0x04d9, 0x04db, 0x04db, 0x04dd, 0x04dd, 0x04df, 0x04df,
+  /* 04E0 */ 0x04e1, 0x04e1, 0x04e3, 0x04e3, 0x04e5, 0x04e5, 0x04e7, 0x04e7,
+  /* 04E8 */ 0x04e9, 0x04e9, 0x04eb, 0x04eb, 0x04ed, 0x04ed, 0x04ef, 0x04ef,
+  /* 04F0 */ 0x04f1, 0x04f1, 0x04f3, 0x04f3, 0x04f5, 0x04f5, 0x04f7, 0x04f7,
+  /* 04F8 */ 0x04f9, 0x04f9, 0x04fb, 0x04fb, 0x04fd, 0x04fd, 0x04ff, 0x04ff,
+  /* 0500 */ 0x0501, 0x0501, 0x0503, 0x0503, 0x0505, 0x0505, 0x0507, 0x0507,
+  /* 0508 */ 0x0509, 0x0509, 0x050b, 0x050b, 0x050d, 0x050d, 0x050f, 0x050f,
+  /* 0510 */ 0x0511, 0x0511, 0x0513, 0x0513, 0x0515, 0x0515, 0x0517, 0x0517,
+  /* 0518 */ 0x0519, 0x0519, 0x051b, 0x051b, 0x051d, 0x051d, 0x051f, 0x051f,
+  /* 0520 */ 0x0521, 0x0521, 0x0523, 0x0523, 0x0525, 0x0525, 0x0527, 0x0527,
+  /* 0528 */ 0x0528, 0x0529, 0x052a, 0x052b, 0x052c, 0x052d, 0x052e, 0x052f
+};
+
+const uint16_t foldLatinAdditional[0x1F00 - 0x1E00] =
+{
+  /* 1E00 */ 0x0061, 0x0061, 0x0062, 0x0062, 0x0062, 0x0062, 0x0062, 0x0062,
+  /* 1E08 */ 0x0063, 0x0063, 0x0064, 0x0064, 0x0064, 0x0064, 0x0064, 0x0064,
+  /* 1E10 */ 0x0064, 0x0064, 0x0064, 0x0064, 0x0065, 0x0065, 0x0065, 0x0065,
+  /* 1E18 */ 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0066, 0x0066,
+  /* 1E20 */ 0x0067, 0x0067, 0x0068, 0x0068, 0x0068, 0x0068, 0x0068, 0x0068,
+  /* 1E28 */ 0x0068, 0x0068, 0x0068, 0x0068, 0x0069, 0x0069, 0x0069, 0x0069,
+  /* 1E30 */ 0x006b, 0x006b, 0x006b, 0x006b, 0x006b, 0x006b, 0x006c, 0x006c,
+  /* 1E38 */ 0x006c, 0x006c, 0x006c, 0x006c, 0x006c, 0x006c, 0x006d, 0x006d,
+  /* 1E40 */ 0x006d, 0x006d, 0x006d, 0x006d, 0x006e, 0x006e, 0x006e, 0x006e,
+  /* 1E48 */ 0x006e, 0x006e, 0x006e, 0x006e, 0x006f, 0x006f, 0x006f, 0x006f,
+  /* 1E50 */ 0x006f, 0x006f, 0x006f, 0x006f, 0x0070, 0x0070, 0x0070, 0x0070,
+  /* 1E58 */ 0x0072, 0x0072, 0x0072, 0x0072, 0x0072, 0x0072, 0x0072, 0x0072,
+  /* 1E60 */ 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073, 0x0073,
+  /* 1E68 */ 0x0073, 0x0073, 0x0074, 0x0074, 0x0074, 0x0074, 0x0074, 0x0074,
+  /* 1E70 */ 0x0074, 0x0074, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075,
+  /* 1E78 */ 0x0075, 0x0075, 0x0075, 0x0075, 0x0076, 0x0076, 0x0076, 0x0076,
+  /* 1E80 */ 0x0077, 0x0077, 0x0077, 0x0077, 0x0077, 0x0077, 0x0077, 0x0077,
+  /* 1E88 */ 0x0077, 0x0077, 0x0078, 0x0078, 0x0078, 0x0078, 0x0079, 0x0079,
+  /* 1E90 */ 0x007a, 0x007a, 0x007a, 0x007a, 0x007a, 0x007a, 0x0068, 0x0074,
+  /* 1E98 */ 0x0077, 0x0079, 0x1e9a, 0x0073, 0x1e9c, 0x1e9d, 0x00df, 0x1e9f,
+  /* 1EA0 */ 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061,
+  /* 1EA8 */ 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061,
+  /* 1EB0 */ 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061, 0x0061,
+  /* 1EB8 */ 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065,
+  /* 1EC0 */ 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065, 0x0065,
+  /* 1EC8 */ 0x0069, 0x0069, 0x0069, 0x0069, 0x006f, 0x006f, 0x006f, 0x006f,
+  /* 1ED0 */ 0x006f, 0x006f, 0x006f, 0x006f, 0x006f, 0x006f, 0x006f, 0x006f,
+  /* 1ED8 */ 0x006f, 0x006f, 0x006f, 0x006f, 0x006f, 0x006f, 0x006f, 0x006f,
+  /* 1EE0 */ 0x006f, 0x006f, 0x006f, 0x006f, 0x0075, 0x0075, 0x0075, 0x0075,
+  /* 1EE8 */ 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075, 0x0075,
+  /* 1EF0 */ 0x0075, 0x0075, 0x0079, 0x0079, 0x0079, 0x0079, 0x0079, 0x0079,
+  /* 1EF8 */ 0x0079, 0x0079, 0x1efb, 0x1efb, 0x1efd, 0x1efd, 0x1eff, 0x1eff
+};
+
+/*
+ * This function folds a code point like foldLatin, characters of other scripts are
+ * kept as they are
+*/
+uint32_t foldChar(uint32_t c)
+{
+  if (c < 0x80)
+    return isalnum(c) ? tolower(c) : SEP;
+  if (c < 0x530)
+    return foldLatin[c - 0x80];
+  if ((c >= 0x1E00) && (c < 0x1F00))
+    return foldLatinAdditional[c - 0x1E00];
+
+  // General punctuation (dashes, quotes, blanks) and currency signs
+  if (((c >= 0x2000) && (c < 0x2065)) || ((c >= 0x206A) && (c < 0x2070)) || ((c >= 0x20A0) && (c < 0x20BA)))
+    return SEP;
+
+  return c;
+}
+
+/*
+ * This function decodes the UTF-8 sequence at text into c and returns its length. Bytes
+ * which don't start a valid sequence are returned as they are.
+*/
+int decodeChar(const unsigned char* text, uint32_t* c)
+{
+  int length;
+  int i;
+
+  if (text[0] < 0xC2)
+    length = 1;
+  else if (text[0] < 0xE0)
+    length = 2;
+  else if (text[0] < 0xF0)
+    length = 3;
+  else if (text[0] < 0xF5)
+    length = 4;
+  else
+    length = 1;
+
+  *c = text[0];
+  if (length == 1)
+    return 1;
+
+  *c &= 0x3F >> (length - 1);
+  for (i = 1; i < length; i++)
+  {
+    if ((text[i] & 0xC0) != 0x80)
+    {
+      *c = text[0];
+      return 1;
+    }
+    *c = (*c << 6) | (text[i] & 0x3F);
+  }
+
+  return length;
+}
+
+/*
+ * This function encodes c as UTF-8 at out and returns the position behind it
+*/
+char* encodeChar(char* out, uint32_t c)
+{
+  if (c < 0x80)
+    *out++ = c;
+  else if (c < 0x800)
+  {
+    *out++ = 0xC0 | (c >> 6);
+    *out++ = 0x80 | (c & 0x3F);
+  }
+  else if (c < 0x10000)
+  {
+    *out++ = 0xE0 | (c >> 12);
+    *out++ = 0x80 | ((c >> 6) & 0x3F);
+    *out++ = 0x80 | (c & 0x3F);
+  }
+  else
+  {
+    *out++ = 0xF0 | (c >> 18);
+    *out++ = 0x80 | ((c >> 12) & 0x3F);
+    *out++ = 0x80 | ((c >> 6) & 0x3F);
+    *out++ = 0x80 | (c & 0x3F);
+  }
+
+  return out;
+}
+
+/*
+ * This function folds text in place (lower case, without diacritics) and splits it into
+ * words by terminating them. It stores up to max starts of words in words and returns
+ * their amount. A folded character never needs more bytes than the original one.
+*/
+int splitTitle(char* text, char** words, int max)
+{
+  const unsigned char* in = (const unsigned char*)text;
+  char* out = text;
+  int count = 0;
+  int inWord = 0;
+
+  while (*in)
+  {
+    uint32_t c;
+    const unsigned char* start = in;
+
+    in += decodeChar(in, &c);
+    uint32_t folded = foldChar(c);
+
+    if (folded == SEP)
+    {
+      if (inWord)
+        *out++ = 0;
+      inWord = 0;
+      continue;
+    }
+    if (folded == DRP)
+      continue;
+
+    if (!inWord && (count < max))
+      words[count++] = out;
+    inWord = 1;
+
+    // Invalid bytes stay as they are
+    if ((in - start == 1) && (c >= 0x80))
+      *out++ = c;
+    else
+      out = encodeChar(out, folded);
+  }
+  *out = 0;
+
+  return count;
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TITLEWORDS_H
+#define _TITLEWORDS_H
+
+/*
+ * Splits titles and search terms into words the way the full-text index of the sqlite
+ * storage does (unicode61 with remove_diacritics 2), so all backends find the same books
+*/
+int splitTitle(char* text, char** words, int max);
+
+#endif // _TITLEWORDS_H
@@ -0,0 +1,390 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "writer.h"
+#include "database.h"
+#include <errno.h>
+#include <glib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WRITE_BEGIN 0
+#define WRITE_BOOK  1
+#define WRITE_END   2
+#define WRITE_STOP  3
+
+// The database is maintained once the writer was idle for MAINTAIN_IDLE seconds after
+// an update, but at most every MAINTAIN_INTERVAL seconds
+#define MAINTAIN_IDLE 2
+#define MAINTAIN_INTERVAL 3600
+
+typedef struct writeitem
+{
+  struct writeitem* _Atomic next;
+  int type;
+  int commit;
+  feedstats stats;
+  char* title;
+  char* url;
+  char* date;
+} writeitem;
+
+/*
+ * The queue is a lock-free intrusive list: the UI thread links new items at the
+ * head, the writer thread takes them from the tail. The semaphore only wakes the
+ * writer, it is never waited on by the UI thread.
+*/
+struct writer
+{
+  writeitem queueStub;
+  writeitem* _Atomic queueHead;
+  writeitem* queueTail;
+  sem_t pending;
+
+  pthread_t thread;
+  char storage[16];
+  char db[1024];
+  GSourceFunc notify;
+};
+
+/*
+ * This function links an item into the queue
+*/
+void linkItem(writer* w, writeitem* item)
+{
+  atomic_store(&item->next, NULL);
+  writeitem* prev = atomic_exchange(&w->queueHead, item);
+  atomic_store(&prev->next, item);
+}
+
+/*
+ * This function appends an item to the queue and wakes the writer thread
+*/
+void pushItem(writer* w, writeitem* item)
+{
+  linkItem(w, item);
+  sem_post(&w->pending);
+}
+
+/*
+ * This function takes the oldest item from the queue, it returns NULL if the queue is
+ * empty or an item is still being linked in by the other thread
+*/
+writeitem* popItem(writer* w)
+{
+  writeitem* item = w->queueTail;
+  writeitem* next = atomic_load(&item->next);
+
+  if (item == &w->queueStub)
+  {
+    if (next == NULL)
+      return NULL;
+    w->queueTail = next;
+    item = next;
+    next = atomic_load(&item->next);
+  }
+
+  if (next != NULL)
+  {
+    w->queueTail = next;
+    return item;
+  }
+
+  if (item != atomic_load(&w->queueHead))
+    return NULL;
+
+  // The queue holds only one item, put the stub behind it so it can be taken
+  linkItem(w, &w->queueStub);
+  next = atomic_load(&item->next);
+  if (next != NULL)
+  {
+    w->queueTail = next;
+    return item;
+  }
+
+  return NULL;
+}
+
+/*
+ * This function creates a queue item, the strings are copied into the same allocation
+*/
+writeitem* newItem(int type, char* title, char* url, char* date)
+{
+  size_t lt = title ? strlen(title) + 1 : 0;
+  size_t lu = url ? strlen(url) + 1 : 0;
+  size_t ld = date ? strlen(date) + 1 : 0;
+  writeitem* item = malloc(sizeof(writeitem) + lt + lu + ld);
+  if (item == NULL)
+  {
+    fprintf(stderr, "Failed to allocate memory for database write\n");
+
+    return NULL;
+  }
+
+  char* pos = (char*)(item + 1);
+  item->type = type;
+  item->commit = 0;
+  item->stats.wireBytes = 0;
+  item->stats.feedBytes = 0;
+  item->title = title ? memcpy(pos, title, lt) : NULL;
+  item->url = url ? memcpy(pos + lt, url, lu) : NULL;
+  item->date = date ? memcpy(pos + lt + lu, date, ld) : NULL;
+
+  return item;
+}
+
+/*
+ * This is the main function of the writer thread. It owns its own database connection and
+ * executes the queued writes, so commits never block the thread running the dockapp.
+*/
+void* writerMain(void* data)
+{
+  writer* w = data;
+  int inTransaction = 0;
+  int failed = 0;
+  int maintenanceDue = 1;   // Right after the start, to convert old databases
+  struct timespec lastMaintenance = { 0, 0 };
+
+  dbcontext* ctx = openDatabase(w->storage, w->db);
+  if (ctx == NULL)
+    fprintf(stderr, "Writer could not open the database, updates will be lost\n");
+  else
+    setBusyTimeout(ctx, 5000);
+
+  while (1)
+  {
+    writeitem* item;
+
+    // Nothing queued for a while, so the database can be maintained without delaying an update
+    if (maintenanceDue && (ctx != NULL) && !inTransaction)
+    {
+      struct timespec until;
+      clock_gettime(CLOCK_REALTIME, &until);
+      until.tv_sec += MAINTAIN_IDLE;
+
+      if (sem_timedwait(&w->pending, &until))
+      {
+        if (errno == ETIMEDOUT)
+        {
+          dbstats stats;
+          if (maintainDatabase(ctx, &stats))
+            fprintf(stderr, "Database maintenance failed\n");
+#ifdef DEBUG
+          else
+            fprintf(stderr, "Database: %li KiB, %i of %i pages free\n", stats.size / 1024, stats.freePages, stats.pages);
+#endif
+          clock_gettime(CLOCK_MONOTONIC, &lastMaintenance);
+          maintenanceDue = 0;
+        }
+        continue;
+      }
+    }
+    else
+      sem_wait(&w->pending);
+    while ((item = popItem(w)) == NULL)
+      sched_yield();
+
+    // Without a database only the notifications are sent
+    if ((ctx == NULL) && (item->type != WRITE_STOP))
+    {
+      if (item->type == WRITE_END)
+        g_idle_add(w->notify, GINT_TO_POINTER(0));
+      free(item);
+      continue;
+    }
+
+    switch (item->type)
+    {
+    case WRITE_BEGIN:
+      // A new snapshot starts, replace the whole list of books
+      if (inTransaction)
+        abortTransaction(ctx);
+      inTransaction = !beginTransaction(ctx);
+      failed = !inTransaction || clearBooklist(ctx);
+      break;
+
+    case WRITE_BOOK:
+      if (inTransaction && !failed)
+        failed = addBook(ctx, item->title, item->url, item->date);
+      break;
+
+    case WRITE_END:
+      // Commit the snapshot together with the time of the update if everything went fine
+      if (inTransaction)
+      {
+        if (item->commit && !failed)
+          failed = updateDone(ctx, &item->stats) || endTransaction(ctx);
+        else
+          failed = 1;
+
+        if (failed)
+          abortTransaction(ctx);
+      }
+      else
+        failed = 1;
+
+      // A failed update is recorded as well, so it is not retried before the next interval
+      if (failed)
+        updateDone(ctx, &item->stats);
+
+      inTransaction = 0;
+      g_idle_add(w->notify, GINT_TO_POINTER(!failed));
+      failed = 0;
+
+      // The maintenance waits until the writer is idle, see above
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if (now.tv_sec - lastMaintenance.tv_sec >= MAINTAIN_INTERVAL)
+        maintenanceDue = 1;
+      break;
+
+    case WRITE_STOP:
+      if (inTransaction)
+        abortTransaction(ctx);
+      if (ctx != NULL)
+        closeDatabase(ctx);
+      free(item);
+
+      return NULL;
+    }
+
+    free(item);
+  }
+}
+
+/*
+ * This function starts a writer thread on the database db of the given storage backend.
+ * The function committed is called in the GLib main context after every finished update,
+ * its parameter is TRUE if a new snapshot was committed. It returns the writer or NULL on
+ * errors. Writers of different databases run independently of each other.
+*/
+writer* startWriter(char* storage, char* db, GSourceFunc committed)
+{
+  writer* w = calloc(1, sizeof(writer));
+  if (w == NULL)
+  {
+    fprintf(stderr, "Failed to allocate memory for the writer\n");
+
+    return NULL;
+  }
+
+  w->queueHead = &w->queueStub;
+  w->queueTail = &w->queueStub;
+  strncpy(w->storage, storage, 15);
+  strncpy(w->db, db, 1023);
+  w->notify = committed;
+
+  if (sem_init(&w->pending, 0, 0))
+  {
+    fprintf(stderr, "Failed to create writer semaphore\n");
+    free(w);
+
+    return NULL;
+  }
+
+  if (pthread_create(&w->thread, NULL, writerMain, w))
+  {
+    fprintf(stderr, "Failed to start writer thread\n");
+    sem_destroy(&w->pending);
+    free(w);
+
+    return NULL;
+  }
+
+  return w;
+}
+
+/*
+ * This function stops the writer thread after all queued writes were done and frees the
+ * writer. It must not be called while an update is still being queued.
+*/
+void stopWriter(writer* w)
+{
+  writeitem* item = newItem(WRITE_STOP, NULL, NULL, NULL);
+  if (item == NULL)
+    return;
+
+  pushItem(w, item);
+  pthread_join(w->thread, NULL);
+  sem_destroy(&w->pending);
+  free(w);
+}
+
+/*
+ * The following functions queue an update. They may be called from any thread, but only
+ * one update at a time may be queued on a writer (the snapshots would be mixed up
+ * otherwise), parallel updates need a writer each.
+*/
+
+/*
+ * This function queues the start of a new snapshot. The book list will be replaced by
+ * the books queued with writeBook until writeEnd is called.
+*/
+int writeBegin(writer* w)
+{
+  writeitem* item = newItem(WRITE_BEGIN, NULL, NULL, NULL);
+  if (item == NULL)
+    return -1;
+
+  pushItem(w, item);
+  return 0;
+}
+
+/*
+ * This function queues a book for the current snapshot
+*/
+int writeBook(writer* w, char* title, char* url, char* date)
+{
+  writeitem* item = newItem(WRITE_BOOK, title, url, date);
+  if (item == NULL)
+    return -1;
+
+  pushItem(w, item);
+  return 0;
+}
+
+/*
+ * This function queues the end of an update. If commit is 0 or any write failed, the
+ * snapshot is rolled back. Every update has to be ended, even if it failed before
+ * writeBegin was called, so the update is recorded and the dockapp gets notified.
+ * The bytes transferred (see feedstats) are recorded with it, NULL if nothing was.
+*/
+int writeEnd(writer* w, int commit, feedstats* stats)
+{
+  writeitem* item = newItem(WRITE_END, NULL, NULL, NULL);
+  if (item == NULL)
+  {
+    // The dockapp waits for the notification, the next writeBegin rolls the snapshot back
+    g_idle_add(w->notify, GINT_TO_POINTER(0));
+
+    return -1;
+  }
+
+  item->commit = commit;
+  if (stats != NULL)
+    item->stats = *stats;
+  pushItem(w, item);
+  return 0;
+}
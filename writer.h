@@ -0,0 +1,34 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _WRITER_H
+#define _WRITER_H
+
+#include "booklist.h"
+#include <glib.h>
+
+typedef struct writer writer;
+
+writer* startWriter(char* storage, char* db, GSourceFunc committed);
+void stopWriter(writer* w);
+int writeBegin(writer* w);
+int writeBook(writer* w, char* title, char* url, char* date);
+int writeEnd(writer* w, int commit, feedstats* stats);
+
+#endif // _WRITER_H
@@ -0,0 +1,433 @@
+/*
+ * Copyright 2009 Jan Dohl
+ *
+ * This file is part of wmslub.
+ *
+ * wmslub is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wmslub is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wmslub.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "xshm.h"
+#include <gai/gai.h>
+#include <gdk/gdkx.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_TARGETS 4
+#define MAX_DEFERRED 10
+
+/*
+ * The frame is composed in frameRgb (0xRRGGBB per pixel) and only the damaged
+ * rectangle is converted into the shared XImage and pushed to the windows.
+*/
+Display* shmDisplay = NULL;
+XImage* shmImage = NULL;
+XShmSegmentInfo shmInfo;
+uint32_t* frameRgb = NULL;
+int frameWidth = 0;
+int frameHeight = 0;
+
+GdkWindow* targets[MAX_TARGETS];
+GC targetGc[MAX_TARGETS];
+int ntargets = 0;
+
+// Damaged rectangle (x0, y0 inclusive, x1, y1 exclusive) and everything drawn so far
+int damageX0, damageY0, damageX1, damageY1;
+int usedX0, usedY0, usedX1, usedY1;
+
+// The server reads the image after XShmPutImage returned, it must not be written until
+// every put was completed (see eventFilter). Flushes meanwhile are deferred.
+int completionType;
+int pendingPuts = 0;
+int deferredFlushes = 0;
+
+// Shifts to convert an RGB value into a pixel of the visual
+int redShift, greenShift, blueShift;
+unsigned long redMask, greenMask, blueMask;
+
+/*
+ * This function extends a rectangle by another one
+*/
+void addRect(int* x0, int* y0, int* x1, int* y1, int x, int y, int width, int height)
+{
+  if (x < *x0)
+    *x0 = x;
+  if (y < *y0)
+    *y0 = y;
+  if (x + width > *x1)
+    *x1 = x + width;
+  if (y + height > *y1)
+    *y1 = y + height;
+}
+
+/*
+ * This function marks a part of the frame as changed, it will be pushed by the next shmFlush
+*/
+void shmDamage(int x, int y, int width, int height)
+{
+  addRect(&damageX0, &damageY0, &damageX1, &damageY1, x, y, width, height);
+}
+
+/*
+ * This function is called by GDK for every event of the target windows. The server
+ * discards the window contents when it gets exposed, so all of it has to be pushed again.
+ * The completion of a put is reported for the window it went to.
+*/
+GdkFilterReturn eventFilter(GdkXEvent* xevent, GdkEvent* event, gpointer data)
+{
+  int type = ((XEvent*)xevent)->type;
+
+  if (type == Expose)
+    shmDamage(usedX0, usedY0, usedX1 - usedX0, usedY1 - usedY0);
+  else if (type == completionType)
+  {
+    if (pendingPuts > 0)
+      pendingPuts--;
+
+    return GDK_FILTER_REMOVE;
+  }
+
+  return GDK_FILTER_CONTINUE;
+}
+
+/*
+ * This function collects all viewable windows with the size of the frame below window.
+ * GAI shows the dockapp in more than one window (e.g. the WindowMaker icon window).
+*/
+void findTargets(GdkWindow* window)
+{
+  int width, height;
+  GList* children;
+  GList* child;
+
+  if (!gdk_window_is_viewable(window))
+    return;
+
+  gdk_drawable_get_size(window, &width, &height);
+  if ((width == frameWidth) && (height == frameHeight) && (ntargets < MAX_TARGETS))
+    targets[ntargets++] = window;
+
+  children = gdk_window_get_children(window);
+  for (child = children; child != NULL; child = child->next)
+    findTargets((GdkWindow*)child->data);
+  g_list_free(children);
+}
+
+/*
+ * This function returns the position of the lowest bit set in mask
+*/
+int maskShift(unsigned long mask)
+{
+  int shift = 0;
+
+  while (mask && !(mask & 1))
+  {
+    mask >>= 1;
+    shift++;
+  }
+
+  return shift;
+}
+
+/*
+ * This function sets up the shared memory frame for the windows of the dockapp. It has to
+ * be called after the windows were shown. If it fails (e.g. on a remote display or a visual
+ * that isn't 32 bit TrueColor), -1 is returned and drawing has to be done through GAI.
+*/
+int initShm(int width, int height)
+{
+  XWindowAttributes attributes;
+  GList* toplevels;
+  GList* toplevel;
+  int i;
+
+  shmDisplay = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
+  if (!XShmQueryExtension(shmDisplay))
+    return -1;
+
+  // Find the windows to draw into
+  frameWidth = width;
+  frameHeight = height;
+  ntargets = 0;
+  toplevels = gdk_window_get_toplevels();
+  for (toplevel = toplevels; toplevel != NULL; toplevel = toplevel->next)
+    findTargets((GdkWindow*)toplevel->data);
+  g_list_free(toplevels);
+
+  if (ntargets == 0)
+    return -1;
+
+  XGetWindowAttributes(shmDisplay, GDK_WINDOW_XID(targets[0]), &attributes);
+  if (attributes.visual->class != TrueColor)
+    return -1;
+
+  // Create the image and attach it to the server
+  shmImage = XShmCreateImage(shmDisplay, attributes.visual, attributes.depth, ZPixmap, NULL, &shmInfo, width, height);
+  if (shmImage == NULL)
+    return -1;
+
+  if (shmImage->bits_per_pixel != 32)
+  {
+    XDestroyImage(shmImage);
+    shmImage = NULL;
+
+    return -1;
+  }
+
+  frameRgb = calloc(width * height, sizeof(uint32_t));
+  if (frameRgb == NULL)
+  {
+    fprintf(stderr, "Failed to allocate memory for the frame, using GAI for drawing\n");
+    XDestroyImage(shmImage);
+    shmImage = NULL;
+
+    return -1;
+  }
+
+  shmInfo.shmid = shmget(IPC_PRIVATE, shmImage->bytes_per_line * shmImage->height, IPC_CREAT | 0600);
+  if (shmInfo.shmid < 0)
+  {
+    XDestroyImage(shmImage);
+    shmImage = NULL;
+    free(frameRgb);
+    frameRgb = NULL;
+
+    return -1;
+  }
+
+  shmInfo.shmaddr = shmat(shmInfo.shmid, NULL, 0);
+  if (shmInfo.shmaddr == (char*)-1)
+  {
+    fprintf(stderr, "Failed to attach shared memory, using GAI for drawing\n");
+    shmctl(shmInfo.shmid, IPC_RMID, NULL);
+    XDestroyImage(shmImage);
+    shmImage = NULL;
+    free(frameRgb);
+    frameRgb = NULL;
+
+    return -1;
+  }
+
+  shmImage->data = shmInfo.shmaddr;
+  shmInfo.readOnly = False;
+
+  gdk_error_trap_push();
+  XShmAttach(shmDisplay, &shmInfo);
+  gdk_flush();
+  int failed = gdk_error_trap_pop();
+
+  // The segment is removed as soon as both sides detached
+  shmctl(shmInfo.shmid, IPC_RMID, NULL);
+
+  if (failed)
+  {
+    fprintf(stderr, "Failed to attach shared memory, using GAI for drawing\n");
+    shmdt(shmInfo.shmaddr);
+    shmImage->data = NULL;
+    XDestroyImage(shmImage);
+    shmImage = NULL;
+    free(frameRgb);
+    frameRgb = NULL;
+
+    return -1;
+  }
+
+  redMask = shmImage->red_mask;
+  greenMask = shmImage->green_mask;
+  blueMask = shmImage->blue_mask;
+  redShift = maskShift(redMask);
+  greenShift = maskShift(greenMask);
+  blueShift = maskShift(blueMask);
+
+  for (i = 0; i < ntargets; i++)
+  {
+    targetGc[i] = XCreateGC(shmDisplay, GDK_WINDOW_XID(targets[i]), 0, NULL);
+    gdk_window_add_filter(targets[i], eventFilter, NULL);
+  }
+  completionType = XShmGetEventBase(shmDisplay) + ShmCompletion;
+  pendingPuts = 0;
+  deferredFlushes = 0;
+
+  damageX0 = usedX0 = width;
+  damageY0 = usedY0 = height;
+  damageX1 = usedX1 = 0;
+  damageY1 = usedY1 = 0;
+
+  return 0;
+}
+
+/*
+ * This function releases the shared memory frame, it does nothing if it wasn't set up
+*/
+void closeShm()
+{
+  int i;
+
+  if (shmImage == NULL)
+    return;
+
+  for (i = 0; i < ntargets; i++)
+  {
+    gdk_window_remove_filter(targets[i], eventFilter, NULL);
+    XFreeGC(shmDisplay, targetGc[i]);
+  }
+  ntargets = 0;
+
+  XShmDetach(shmDisplay, &shmInfo);
+  XSync(shmDisplay, False);
+  shmdt(shmInfo.shmaddr);
+  shmImage->data = NULL;
+  XDestroyImage(shmImage);
+  shmImage = NULL;
+
+  free(frameRgb);
+  frameRgb = NULL;
+}
+
+/*
+ * This function clips a rectangle to the frame, it returns 0 if nothing is left
+*/
+int clip(int* x, int* y, int* width, int* height)
+{
+  if (*x < 0)
+  {
+    *width += *x;
+    *x = 0;
+  }
+  if (*y < 0)
+  {
+    *height += *y;
+    *y = 0;
+  }
+  if (*x + *width > frameWidth)
+    *width = frameWidth - *x;
+  if (*y + *height > frameHeight)
+    *height = frameHeight - *y;
+
+  return (*width > 0) && (*height > 0);
+}
+
+/*
+ * This function fills a rectangle of the frame with the color rgb (0xRRGGBB)
+*/
+void shmFill(int x, int y, int width, int height, unsigned int rgb)
+{
+  int i, j;
+
+  if (!clip(&x, &y, &width, &height))
+    return;
+
+  for (j = y; j < y + height; j++)
+    for (i = x; i < x + width; i++)
+      frameRgb[j * frameWidth + i] = rgb;
+
+  shmDamage(x, y, width, height);
+  addRect(&usedX0, &usedY0, &usedX1, &usedY1, x, y, width, height);
+}
+
+/*
+ * This function draws a pixbuf onto the frame, blending it by its alpha channel
+*/
+void shmDraw(GdkPixbuf* pixbuf, int x, int y)
+{
+  int width = gdk_pixbuf_get_width(pixbuf);
+  int height = gdk_pixbuf_get_height(pixbuf);
+  int stride = gdk_pixbuf_get_rowstride(pixbuf);
+  int channels = gdk_pixbuf_get_n_channels(pixbuf);
+  int alpha = gdk_pixbuf_get_has_alpha(pixbuf);
+  unsigned char* pixels = gdk_pixbuf_get_pixels(pixbuf);
+  int i, j;
+
+  for (j = 0; j < height; j++)
+  {
+    if ((y + j < 0) || (y + j >= frameHeight))
+      continue;
+
+    for (i = 0; i < width; i++)
+    {
+      if ((x + i < 0) || (x + i >= frameWidth))
+        continue;
+
+      unsigned char* src = &pixels[j * stride + i * channels];
+      uint32_t* dst = &frameRgb[(y + j) * frameWidth + x + i];
+      unsigned int a = alpha ? src[3] : 255;
+      unsigned int r = (src[0] * a + ((*dst >> 16) & 0xFF) * (255 - a)) / 255;
+      unsigned int g = (src[1] * a + ((*dst >> 8) & 0xFF) * (255 - a)) / 255;
+      unsigned int b = (src[2] * a + (*dst & 0xFF) * (255 - a)) / 255;
+
+      *dst = (r << 16) | (g << 8) | b;
+    }
+  }
+
+  shmDamage(x, y, width, height);
+  addRect(&usedX0, &usedY0, &usedX1, &usedY1, x, y, width, height);
+}
+
+/*
+ * This function pushes the damaged part of the frame to the windows, nothing is sent to
+ * the server if nothing changed. While the server still reads the last push, the damage
+ * is kept for the next flush. Completions that don't come (e.g. for a window that was
+ * destroyed) are waited for with XSync after MAX_DEFERRED flushes.
+*/
+void shmFlush()
+{
+  int x = damageX0;
+  int y = damageY0;
+  int width = damageX1 - damageX0;
+  int height = damageY1 - damageY0;
+  int i, j;
+
+  if (!clip(&x, &y, &width, &height))
+    return;
+
+  if (pendingPuts > 0)
+  {
+    if (++deferredFlushes < MAX_DEFERRED)
+      return;
+
+    XSync(shmDisplay, False);
+    pendingPuts = 0;
+  }
+  deferredFlushes = 0;
+
+  // Convert the damaged pixels into the format of the visual
+  for (j = y; j < y + height; j++)
+  {
+    uint32_t* dst = (uint32_t*)(shmImage->data + j * shmImage->bytes_per_line);
+    for (i = x; i < x + width; i++)
+    {
+      uint32_t rgb = frameRgb[j * frameWidth + i];
+      dst[i] = ((((rgb >> 16) & 0xFF) << redShift) & redMask) |
+               ((((rgb >> 8) & 0xFF) << greenShift) & greenMask) |
+               (((rgb & 0xFF) << blueShift) & blueMask);
+    }
+  }
+
+  for (i = 0; i < ntargets; i++)
+  {
+    if (XShmPutImage(shmDisplay, GDK_WINDOW_XID(targets[i]), targetGc[i], shmImage, x, y, x, y, width, height, True))
+      pendingPuts++;
+  }
+  XFlush(shmDisplay);
+
+  damageX0 = frameWidth;
+  damageY0 = frameHeight;
+  damageX1 = 0;
+  damageY1 = 0;
+}